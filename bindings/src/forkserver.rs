@@ -6,13 +6,29 @@ use nix::{
     unistd::Pid,
 };
 use std::process::{Command, Stdio, Child};
+use std::fs::File;
+use std::ffi::CStr;
+use std::os::fd::{AsRawFd, FromRawFd};
+use std::os::unix::fs::FileExt;
+use std::os::unix::process::CommandExt;
+use memmap2::{MmapMut, MmapOptions};
 use crate::ipc::ForkserverIPC;
+use crate::trace::{TraceRing, TraceEvent, TraceEventKind, TRACE_SHM_ENV_VAR};
 
 const FORKSERVER_MAGIC_MASK: u32 = 0xFFFF0000;
 const FORKSERVER_VERSION_MASK: u32 = 0x0000FF00;
 const FORKSERVER_MODE_MASK: u32 = 0x000000FF;
 const FORKSERVER_MAGIC: u32 = 0xDEAD0000;
+const FORKSERVER_VERSION: u32 = 2;
 const FUZZ_INPUT_SHM_ENV_VAR: &str = "__FUZZ_INPUT_SHM";
+const FUZZ_INPUT_FD_ENV_VAR: &str = "__FUZZ_INPUT_FD";
+const FUZZ_OUTPUT_FD_ENV_VAR: &str = "__FUZZ_OUTPUT_FD";
+const FUZZ_OUTPUT_CAP_ENV_VAR: &str = "__FUZZ_OUTPUT_CAP";
+const NETEMU_PORT_ENV_VAR: &str = "CHEETAH_NETEMU_PORT";
+const NETEMU_LIBRARY: &str = "libnetemu.so";
+const LEAK_CHECK_INTERVAL_ENV_VAR: &str = "CHEETAH_LEAK_CHECK_INTERVAL";
+const FORK_PROFILE_ENV_VAR: &str = "CHEETAH_FORK_PROFILE";
+const FORK_PROFILE_REPORT_ENV_VAR: &str = "CHEETAH_FORK_PROFILE_REPORT";
 
 #[repr(u8)]
 enum ForkserverCommand {
@@ -25,6 +41,7 @@ enum ForkserverStatus {
     Exit = 0,
     Crash = 1,
     Timeout = 2,
+    Leak = 3,
 }
 
 impl TryFrom<u8> for ForkserverStatus {
@@ -35,6 +52,7 @@ impl TryFrom<u8> for ForkserverStatus {
             0 => Ok(Self::Exit),
             1 => Ok(Self::Crash),
             2 => Ok(Self::Timeout),
+            3 => Ok(Self::Leak),
             _ => Err(Error::unknown(format!("Received invalid forkserver status: {value}"))),
         }
     }
@@ -90,13 +108,139 @@ struct InputChannelMetadata {
     max_length: usize,
 }
 
+fn create_memfd(name: &CStr) -> Result<File, Error> {
+    let fd = unsafe { libc::memfd_create(name.as_ptr(), libc::MFD_CLOEXEC) };
+    
+    if fd == -1 {
+        return Err(Error::last_os_error("Could not create memfd"));
+    }
+    
+    Ok(unsafe { File::from_raw_fd(fd) })
+}
+
+/// Input data that is delivered through a memfd instead of the shm.
+/// The size of the file always equals the length of the current input
+/// such that the target sees a proper EOF.
+#[derive(Debug)]
+struct InputMemfd {
+    file: File,
+    mmap: MmapMut,
+    as_stdin: bool,
+}
+
+#[derive(Debug)]
+struct InputChannel {
+    shmem: UnixShMem,
+    memfd: Option<InputMemfd>,
+    /// Size up to which the channel may grow
+    limit: usize,
+}
+
+impl InputChannel {
+    #[inline(always)]
+    fn header(&mut self) -> &mut InputChannelMetadata {
+        unsafe { &mut *self.shmem.as_mut_ptr_of::<InputChannelMetadata>().unwrap_unchecked() }
+    }
+    
+    #[inline(always)]
+    fn resize_memfd(&mut self, length: usize) {
+        if let Some(memfd) = &mut self.memfd {
+            memfd.file.set_len(length as u64).expect("Could not resize input memfd");
+        }
+    }
+    
+    #[inline(always)]
+    fn data(&mut self) -> &mut [u8] {
+        if let Some(memfd) = &mut self.memfd {
+            &mut memfd.mmap[..]
+        } else {
+            &mut self.shmem.as_slice_mut()[size_of::<InputChannelMetadata>()..]
+        }
+    }
+    
+    /// Replaces the channel with one that can hold at least `length` bytes.
+    /// The target switches over before its next run.
+    fn grow(&mut self, length: usize, ipc: &mut ForkserverIPC) -> Result<(), Error> {
+        let old_length = self.header().max_length;
+        let new_length = std::cmp::min(
+            std::cmp::max(length, old_length.saturating_mul(2)),
+            self.limit,
+        );
+        
+        if let Some(memfd) = &mut self.memfd {
+            memfd.mmap = unsafe { MmapOptions::new().len(new_length).map_mut(&memfd.file)? };
+        } else {
+            let mut shmem_provider = UnixShMemProvider::new()?;
+            let mut shmem = shmem_provider.new_shmem(size_of::<InputChannelMetadata>() + new_length)?;
+            let used = size_of::<InputChannelMetadata>() + old_length;
+            shmem.as_slice_mut()[..used].copy_from_slice(&self.shmem.as_slice_mut()[..used]);
+            
+            // The target keeps the old shm alive until it attached to the new one
+            self.shmem = shmem;
+        }
+        
+        self.header().max_length = new_length;
+        
+        let shm_id = self.shmem.id().to_string().parse::<i32>().map_err(|_| Error::illegal_state("Invalid shm id"))?;
+        ipc.announce_input_channel(shm_id);
+        
+        Ok(())
+    }
+}
+
+/// A memfd that is the stdout and stderr of the target.
+/// The target rewinds it at the start of every iteration so it
+/// only holds the output of the current iteration.
+#[derive(Debug)]
+struct OutputCapture {
+    file: File,
+    tail_size: usize,
+}
+
+impl OutputCapture {
+    fn read_tail(&self) -> Vec<u8> {
+        // The file offset is shared with the target and marks the end of the output
+        let end = unsafe { libc::lseek(self.file.as_raw_fd(), 0, libc::SEEK_CUR) };
+        
+        if end <= 0 {
+            return Vec::new();
+        }
+        
+        let end = end as usize;
+        let start = end.saturating_sub(self.tail_size);
+        let mut buffer = vec![0; end - start];
+        let length = self.file.read_at(&mut buffer, start as u64).unwrap_or(0);
+        buffer.truncate(length);
+        buffer
+    }
+}
+
+/// Information that the target gathered about a crash in its signal handler
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct CrashInfo {
+    /// Signal that caused the crash
+    pub signal: i32,
+    /// Faulting address of the signal (or of the sanitizer report)
+    pub fault_address: u64,
+    /// Crashing instruction, relative to the base of its module
+    pub pc: u64,
+    /// Hash over the module-relative addresses of the top frames of the stack.
+    /// Suitable for bucketing crashes.
+    pub hash: u64,
+}
+
 #[derive(Debug)]
 pub struct Forkserver {
     child: Child,
     mode: ForkserverMode,
     ipc: ForkserverIPC,
     signal: Signal,
-    shmem: Option<UnixShMem>,
+    input: Option<InputChannel>,
+    leaking_input: Option<Vec<u8>>,
+    last_crash: Option<CrashInfo>,
+    output: Option<OutputCapture>,
+    last_output: Option<Vec<u8>>,
+    trace: Option<TraceRing>,
 }
 
 impl Forkserver {
@@ -108,7 +252,7 @@ impl Forkserver {
         &self.mode
     }
     
-    fn handshake(child: Child, mut ipc: ForkserverIPC, timeout: u32, signal: Signal, crash_exit_codes: Vec<u8>, shmem: Option<UnixShMem>) -> Result<Self, Error> {
+    fn handshake(child: Child, mut ipc: ForkserverIPC, timeout: u32, signal: Signal, crash_exit_codes: Vec<u8>, input: Option<InputChannel>, output: Option<OutputCapture>, trace: Option<TraceRing>) -> Result<Self, Error> {
         /* First, check client hello */
         let mut buffer = [0u8; 4];
         ipc.recv_exact(&mut buffer)?;
@@ -120,8 +264,8 @@ impl Forkserver {
         }
         
         let version = (client_hello & FORKSERVER_VERSION_MASK) >> 8;
-        if version != 1 {
-            return Err(Error::unknown(format!("Unsupported forkserver version. Client is on version {version}, we are on version 1")));
+        if version != FORKSERVER_VERSION {
+            return Err(Error::unknown(format!("Unsupported forkserver version. Client is on version {version}, we are on version {FORKSERVER_VERSION}")));
         }
         
         let mode = ForkserverMode::try_from(client_hello & FORKSERVER_MODE_MASK)?;
@@ -149,7 +293,12 @@ impl Forkserver {
             mode,
             ipc,
             signal,
-            shmem,
+            input,
+            leaking_input: None,
+            last_crash: None,
+            output,
+            last_output: None,
+            trace,
         })
     }
 
@@ -169,49 +318,113 @@ impl Forkserver {
     }
     
     pub fn run_target(&mut self) -> Result<ExitKind, Error> {
+        if let Some(trace) = &self.trace {
+            trace.record(TraceEventKind::RunStart, 0);
+        }
+        
         /* Launch target */
+        self.ipc.clear_crash_record();
         self.ipc.send_command(ForkserverCommand::Run as u8)?;
         
         /* Collect status */
         let status = self.ipc.recv_status()?;
-        match ForkserverStatus::try_from(status)? {
+        
+        if let Some(trace) = &self.trace {
+            trace.record(TraceEventKind::RunEnd, status as u64);
+        }
+        self.last_crash = None;
+        self.last_output = None;
+        
+        let status = ForkserverStatus::try_from(status)?;
+        
+        if matches!(status, ForkserverStatus::Crash | ForkserverStatus::Timeout) {
+            self.last_output = self.output.as_ref().map(OutputCapture::read_tail);
+        }
+        
+        match status {
             ForkserverStatus::Exit => Ok(ExitKind::Ok),
-            ForkserverStatus::Crash => Ok(ExitKind::Crash),
+            ForkserverStatus::Crash => {
+                self.last_crash = self.ipc.take_crash_record().map(|record| CrashInfo {
+                    signal: record.signal,
+                    fault_address: record.fault_address,
+                    pc: record.pc,
+                    hash: record.hash,
+                });
+                Ok(ExitKind::Crash)
+            },
             ForkserverStatus::Timeout => Ok(ExitKind::Timeout),
+            ForkserverStatus::Leak => {
+                // The target placed the input that caused the leak into the input channel
+                let input = self.input.as_mut().expect("Target reported a leak without an input channel");
+                let length = input.header().length;
+                self.leaking_input = Some(input.data()[..length].to_vec());
+                Ok(ExitKind::Crash)
+            },
         }
     }
     
+    /// Details about the crash of the last [`Forkserver::run_target`], if the
+    /// target could record them. Crashes that are signalled via exit codes have no details.
+    pub fn last_crash(&self) -> Option<&CrashInfo> {
+        self.last_crash.as_ref()
+    }
+    
+    /// Events that the target and the fuzzer recorded into the trace ring, oldest first.
+    /// See [`crate::trace_to_chrome_json`] for viewing them.
+    /// Requires [`ForkserverBuilder::trace_events`].
+    pub fn trace_events(&self) -> Vec<TraceEvent> {
+        self.trace.as_ref().map(TraceRing::events).unwrap_or_default()
+    }
+    
+    /// The last bytes that the target wrote to stdout and stderr if the last
+    /// [`Forkserver::run_target`] crashed or timed out.
+    /// Requires [`ForkserverBuilder::capture_output`].
+    pub fn take_output(&mut self) -> Option<Vec<u8>> {
+        self.last_output.take()
+    }
+    
+    /// If the last [`Forkserver::run_target`] reported a crash because of a leak
+    /// that was found by a batched leak check, this returns the input that leaked.
+    /// It is not necessarily the input of the last execution.
+    pub fn take_leaking_input(&mut self) -> Option<Vec<u8>> {
+        self.leaking_input.take()
+    }
+    
+    /// Places `data` into the input channel and returns how many bytes were written.
+    /// Data that exceeds the capacity of the channel is truncated unless the channel
+    /// may still grow, see [`ForkserverBuilder::growable_input`].
     pub fn input_channel_write<D: AsRef<[u8]>>(&mut self, data: D) -> usize {
-        const OFFSET: usize = size_of::<InputChannelMetadata>();
-        let length;
         let data = data.as_ref();
-        let shmem = self.shmem.as_mut().expect("Tried to write into input channel even though it wasn't setup");
+        let input = self.input.as_mut().expect("Tried to write into input channel even though it wasn't setup");
         
-        unsafe {
-            let header = &mut *shmem.as_mut_ptr_of::<InputChannelMetadata>().unwrap_unchecked();
-            
-            length = std::cmp::min(data.len(), header.max_length);
-            header.length = length;
+        if data.len() > input.header().max_length && input.header().max_length < input.limit {
+            input.grow(data.len(), &mut self.ipc).expect("Could not grow input channel");
         }
-        shmem.as_slice_mut()[OFFSET..OFFSET + length].copy_from_slice(&data[..length]);
+        
+        let length = std::cmp::min(data.len(), input.header().max_length);
+        
+        input.header().length = length;
+        input.resize_memfd(length);
+        input.data()[..length].copy_from_slice(&data[..length]);
         
         length
     }
     
     pub fn input_channel_set_data(&mut self) -> &mut [u8] {
-        let shmem = self.shmem.as_mut().expect("Tried to write into input channel even though it wasn't setup");
-        &mut shmem.as_slice_mut()[size_of::<InputChannelMetadata>()..]
+        let input = self.input.as_mut().expect("Tried to write into input channel even though it wasn't setup");
+        let max_length = input.header().max_length;
+        input.resize_memfd(max_length);
+        input.data()
     }
     
     pub fn input_channel_set_len(&mut self, length: usize) {
-        let shmem = self.shmem.as_mut().expect("Tried to write into input channel even though it wasn't setup");
-        unsafe {
-            let header = &mut *shmem.as_mut_ptr_of::<InputChannelMetadata>().unwrap_unchecked();
-            header.length = std::cmp::min(
-                length,
-                header.max_length,
-            );
-        }
+        let input = self.input.as_mut().expect("Tried to write into input channel even though it wasn't setup");
+        let length = std::cmp::min(
+            length,
+            input.header().max_length,
+        );
+        input.header().length = length;
+        input.resize_memfd(length);
     }
 }
 
@@ -236,6 +449,11 @@ pub struct ForkserverBuilder {
     output: bool,
     crash_exit_code: Vec<u8>,
     shmem_size: Option<usize>,
+    memfd: Option<bool>,
+    capture: Option<usize>,
+    input_limit: usize,
+    trace: Option<usize>,
+    netemu: bool,
 }
 
 impl Default for ForkserverBuilder {
@@ -249,6 +467,11 @@ impl Default for ForkserverBuilder {
             output: false,
             crash_exit_code: Vec::new(),
             shmem_size: None,
+            memfd: None,
+            capture: None,
+            input_limit: 0,
+            trace: None,
+            netemu: false,
         }
     }
 }
@@ -309,31 +532,161 @@ impl ForkserverBuilder {
         self
     }
     
-    fn setup_shm(&self) -> Result<Option<UnixShMem>, Error> {
+    /// Let the input channel grow up to `max_input_size` bytes when an input does not
+    /// fit into it, instead of truncating the input. The channel starts with the size given to
+    /// [`ForkserverBuilder::use_shmem`] and at least doubles on every growth.
+    pub fn growable_input(mut self, max_input_size: usize) -> Self {
+        self.input_limit = max_input_size;
+        self
+    }
+    
+    /// Run LeakSanitizer every `iterations` iterations in persistent mode instead of
+    /// only when a persistent child exits, see [`Forkserver::take_leaking_input`].
+    /// Requires [`ForkserverBuilder::use_shmem`].
+    pub fn leak_check_interval(self, iterations: usize) -> Self {
+        self.env(LEAK_CHECK_INTERVAL_ENV_VAR, format!("{iterations}"))
+    }
+    
+    /// Let the target report at its fork point which mappings make fork() expensive.
+    /// The report is written to `report` or to the stderr of the target if it is `None`.
+    pub fn profile_fork<P: Into<OsString>>(self, report: Option<P>) -> Self {
+        let builder = self.env(FORK_PROFILE_ENV_VAR, "1");
+        
+        if let Some(report) = report {
+            builder.env(FORK_PROFILE_REPORT_ENV_VAR, report)
+        } else {
+            builder
+        }
+    }
+    
+    /// Emulate the listening socket that the target binds to `port`.
+    /// Each accepted connection is one iteration of the persistent loop and
+    /// serves the messages of the input, see [`crate::encode_messages`].
+    /// This preloads `libnetemu.so` into the target, so it must be in the library search path.
+    pub fn emulate_network(mut self, port: u16) -> Self {
+        self.netemu = true;
+        self.env(NETEMU_PORT_ENV_VAR, format!("{port}"))
+    }
+    
+    /// Deliver the input data over a memfd in addition to the pointer API.
+    /// If `as_stdin` is set, the memfd becomes the stdin of the target, otherwise
+    /// arguments equal to `@@` are replaced with a `/dev/fd/N` path to the memfd.
+    /// Requires [`ForkserverBuilder::use_shmem`].
+    pub fn use_memfd(mut self, as_stdin: bool) -> Self {
+        self.memfd = Some(as_stdin);
+        self
+    }
+    
+    /// Record timestamped events of the forkserver, the persistent loop and of [`Forkserver::run_target`]
+    /// into a shared ring buffer that holds the last `capacity` events, see [`Forkserver::trace_events`].
+    pub fn trace_events(mut self, capacity: usize) -> Self {
+        self.trace = Some(capacity);
+        self
+    }
+    
+    /// Redirect stdout and stderr of the target into a memfd instead of a pipe or /dev/null.
+    /// When a run crashes or times out, the last `tail_size` bytes of the output of that run
+    /// are available via [`Forkserver::take_output`]. Overrides [`ForkserverBuilder::debug_output`].
+    /// The memfd is truncated back to `tail_size` after every iteration that wrote more.
+    pub fn capture_output(mut self, tail_size: usize) -> Self {
+        self.capture = Some(tail_size);
+        self
+    }
+    
+    fn setup_shm(&self) -> Result<Option<InputChannel>, Error> {
         if let Some(shmem_size) = &self.shmem_size {
             let mut shmem_provider = UnixShMemProvider::new()?;
-            let mut shmem = shmem_provider.new_shmem(size_of::<InputChannelMetadata>() + *shmem_size)?;
+            let memfd = if let Some(as_stdin) = self.memfd {
+                let file = create_memfd(c"fuzz-input")?;
+                let mmap = unsafe { MmapOptions::new().len(*shmem_size).map_mut(&file)? };
+                Some(InputMemfd {
+                    file,
+                    mmap,
+                    as_stdin,
+                })
+            } else {
+                None
+            };
+            let data_size = if memfd.is_some() { 0 } else { *shmem_size };
+            let mut shmem = shmem_provider.new_shmem(size_of::<InputChannelMetadata>() + data_size)?;
             unsafe {
                 let header = &mut *shmem.as_mut_ptr_of::<InputChannelMetadata>().unwrap_unchecked();
                 header.max_length = *shmem_size;
                 
                 shmem.write_to_env(FUZZ_INPUT_SHM_ENV_VAR)?;
             }
-            Ok(Some(shmem))
+            Ok(Some(InputChannel {
+                shmem,
+                memfd,
+                limit: std::cmp::max(*shmem_size, self.input_limit),
+            }))
         } else {
             Ok(None)
         }
     }
     
     pub fn spawn(mut self) -> Result<Forkserver, Error> {
-        let ipc = ForkserverIPC::new()?;
-        let shmem = self.setup_shm()?;
+        let mut ipc = ForkserverIPC::new()?;
+        let input = self.setup_shm()?;
+        
+        if let Some(input) = &input {
+            ipc.set_input_limit(input.limit);
+        }
         let binary = self.binary.expect("No binary given to forkserver");
         
         let mut command = Command::new(binary);
-        command.args(self.args);
         
-        if self.output {
+        if let Some(memfd) = input.as_ref().and_then(|input| input.memfd.as_ref()) {
+            if memfd.as_stdin {
+                command.stdin(Stdio::from(memfd.file.try_clone()?));
+                command.env(FUZZ_INPUT_FD_ENV_VAR, "0");
+            } else {
+                let fd = memfd.file.as_raw_fd();
+                let path = format!("/dev/fd/{fd}");
+                command.env(FUZZ_INPUT_FD_ENV_VAR, format!("{fd}"));
+                
+                // The memfd is close-on-exec such that it does not leak into other processes
+                // of the fuzzer, only the target inherits it
+                unsafe {
+                    command.pre_exec(move || {
+                        if libc::fcntl(fd, libc::F_SETFD, 0) == -1 {
+                            return Err(std::io::Error::last_os_error());
+                        }
+                        
+                        Ok(())
+                    });
+                }
+                command.args(self.args.iter().map(|arg| if arg == "@@" { OsStr::new(&path) } else { arg.as_os_str() }));
+            }
+        } else {
+            command.args(self.args);
+        }
+        
+        let output = if let Some(tail_size) = self.capture {
+            let file = create_memfd(c"fuzz-output")?;
+            command.stdout(Stdio::from(file.try_clone()?));
+            command.stderr(Stdio::from(file.try_clone()?));
+            command.env(FUZZ_OUTPUT_FD_ENV_VAR, "1");
+            command.env(FUZZ_OUTPUT_CAP_ENV_VAR, tail_size.to_string());
+            Some(OutputCapture {
+                file,
+                tail_size,
+            })
+        } else {
+            None
+        };
+        
+        let trace = if let Some(capacity) = self.trace {
+            let trace = TraceRing::new(capacity)?;
+            command.env(TRACE_SHM_ENV_VAR, trace.shm_id());
+            Some(trace)
+        } else {
+            None
+        };
+        
+        if output.is_some() {
+            // stdout and stderr are the output memfd
+        } else if self.output {
             command.stdout(Stdio::inherit());
             command.stderr(Stdio::inherit());
         } else {
@@ -344,18 +697,31 @@ impl ForkserverBuilder {
         let mut has_ld_bind_now = false;
         let mut has_lsan_options = false;
         let mut has_asan_options = false;
+        let mut ld_preload = std::env::var_os("LD_PRELOAD");
         
-        for (key, _) in &self.env {
+        for (key, value) in &self.env {
             match key.as_os_str().to_str() {
                 Some("LD_BIND_NOW") => has_ld_bind_now = true,
                 Some("LSAN_OPTIONS") => has_lsan_options = true,
                 Some("ASAN_OPTIONS") => has_asan_options = true,
+                Some("LD_PRELOAD") => ld_preload = Some(value.clone()),
                 _ => {},
             }
         }
         
         command.envs(self.env);
         
+        if self.netemu {
+            let mut preload = OsString::from(NETEMU_LIBRARY);
+            
+            if let Some(other) = ld_preload.filter(|other| !other.is_empty()) {
+                preload.push(":");
+                preload.push(other);
+            }
+            
+            command.env("LD_PRELOAD", preload);
+        }
+        
         if !has_ld_bind_now && std::env::var("LD_BIND_NOW").is_err() {
             command.env("LD_BIND_NOW", "1");
         }
@@ -369,7 +735,7 @@ impl ForkserverBuilder {
         
         let handle = command.spawn()?;
         
-        Forkserver::handshake(handle, ipc, self.timeout, self.signal, self.crash_exit_code, shmem)
+        Forkserver::handshake(handle, ipc, self.timeout, self.signal, self.crash_exit_code, input, output, trace)
     }
 }
 
@@ -505,6 +871,36 @@ mod tests {
         }
     }
     
+    #[test]
+    fn bench_input_access() -> Result<(), Error> {
+        // Either "calls" or "inline", see tests/input-bench.c
+        const BENCH_INPUT_SIZE: usize = 1024;
+        const RUNS: usize = 1_000_000;
+        let mode = std::env::var("MODE").unwrap_or_else(|_| "inline".to_string());
+        
+        let mut forkserver = super::Forkserver::builder()
+            .binary("../tests/input-bench")
+            .arg(&mode)
+            .timeout_ms(60_000)
+            .kill_signal("SIGKILL").unwrap()
+            .debug_output(true)
+            .use_shmem(BENCH_INPUT_SIZE)
+            .spawn()?;
+        
+        // The input stays the same for all executions
+        forkserver.input_channel_write([0x41u8; BENCH_INPUT_SIZE]);
+        
+        let start = std::time::Instant::now();
+        
+        for _ in 0..RUNS {
+            assert_eq!(forkserver.run_target()?, ExitKind::Ok);
+        }
+        
+        let elapsed = start.elapsed();
+        println!("{mode}: {:.0} exec/sec", RUNS as f64 / elapsed.as_secs_f64());
+        Ok(())
+    }
+    
     #[test]
     fn bench_afl() -> Result<(), Error> {
         const MAP_SIZE: usize = 65535;
@@ -615,6 +1011,133 @@ mod tests {
         forkserver.run_target().unwrap();
     }
     
+    #[test]
+    fn test_memfd_echo() {
+        for as_stdin in [true, false] {
+            let mut forkserver = super::Forkserver::builder()
+                .binary("../tests/memfd-echo")
+                .args(if as_stdin { vec![] } else { vec!["@@"] })
+                .env("LD_LIBRARY_PATH", "../runtime")
+                .timeout_ms(5_000)
+                .kill_signal("SIGKILL").unwrap()
+                .debug_output(true)
+                .use_shmem(4096)
+                .use_memfd(as_stdin)
+                .spawn().unwrap();
+            
+            for input in [&b"Test123"[..], b"Test", b"", &[b'A'; 4096]] {
+                assert_eq!(forkserver.input_channel_write(input), input.len());
+                assert_eq!(forkserver.run_target().unwrap(), ExitKind::Ok);
+            }
+        }
+    }
+    
+    #[test]
+    fn test_growable_input() {
+        let mut forkserver = super::Forkserver::builder()
+            .binary("../tests/input-pattern")
+            .env("LD_LIBRARY_PATH", "../runtime")
+            .timeout_ms(5_000)
+            .kill_signal("SIGKILL").unwrap()
+            .use_shmem(16)
+            .growable_input(65536)
+            .spawn().unwrap();
+        
+        // The target checks the length in the first 8 bytes and the pattern and crashes on request.
+        // Alternating the crash request makes reads from a stale input channel visible.
+        let pattern = |length: usize, expected: usize, crash: bool| {
+            let mut input: Vec<u8> = (0..length).map(|i| (i % 251) as u8).collect();
+            input[..8].copy_from_slice(&(expected as u64).to_ne_bytes());
+            input[8] = if crash { b'C' } else { 0 };
+            input
+        };
+        
+        for (i, length) in [9, 100, 10_000, 65_536, 100_000].into_iter().enumerate() {
+            let expected = std::cmp::min(length, 65536);
+            let crash = i % 2 == 1;
+            assert_eq!(forkserver.input_channel_write(pattern(length, expected, crash)), expected);
+            assert_eq!(forkserver.run_target().unwrap(), if crash { ExitKind::Crash } else { ExitKind::Ok });
+        }
+        
+        forkserver.input_channel_write(pattern(100, 99, false));
+        assert_eq!(forkserver.run_target().unwrap(), ExitKind::Crash);
+        
+        let mut forkserver = super::Forkserver::builder()
+            .binary("../tests/memfd-echo")
+            .env("LD_LIBRARY_PATH", "../runtime")
+            .timeout_ms(5_000)
+            .kill_signal("SIGKILL").unwrap()
+            .use_shmem(16)
+            .use_memfd(true)
+            .growable_input(4096)
+            .spawn().unwrap();
+        
+        for length in [8, 100, 4096] {
+            let input = vec![b'A'; length];
+            assert_eq!(forkserver.input_channel_write(&input), length);
+            assert_eq!(forkserver.run_target().unwrap(), ExitKind::Ok);
+        }
+    }
+    
+    #[test]
+    fn test_netemu() {
+        let mut forkserver = super::Forkserver::builder()
+            .binary("../tests/netemu-server")
+            .env("LD_LIBRARY_PATH", "../runtime")
+            .timeout_ms(5_000)
+            .kill_signal("SIGKILL").unwrap()
+            .debug_output(true)
+            .use_shmem(4096)
+            .emulate_network(31337)
+            .spawn().unwrap();
+        
+        let mut check = |messages: &[&[u8]], code| {
+            let input = crate::encode_messages(messages);
+            assert_eq!(
+                forkserver.input_channel_write(&input),
+                input.len()
+            );
+            assert_eq!(
+                forkserver.run_target().unwrap(),
+                code
+            );
+        };
+        
+        check(&[b"hello", b"world"], ExitKind::Ok);
+        check(&[b"crash"], ExitKind::Crash);
+        check(&[b"hello", b"quit", b"crash"], ExitKind::Ok);
+        check(&[], ExitKind::Ok);
+        check(&[b"hello", b"crash"], ExitKind::Crash);
+        check(&[b"hello"], ExitKind::Ok);
+    }
+    
+    #[test]
+    fn test_libfuzzer_driver() {
+        let mut forkserver = super::Forkserver::builder()
+            .binary("../tests/libfuzzer-harness")
+            .env("LD_LIBRARY_PATH", "../runtime")
+            .timeout_ms(5_000)
+            .kill_signal("SIGKILL").unwrap()
+            .debug_output(true)
+            .use_shmem(4096)
+            .spawn().unwrap();
+        
+        assert_eq!(forkserver.mode(), &ForkserverMode::Persistent);
+        
+        let mut check = |input: &[u8], code| {
+            forkserver.input_channel_write(input);
+            assert_eq!(
+                forkserver.run_target().unwrap(),
+                code
+            );
+        };
+        
+        check(b"nothing", ExitKind::Ok);
+        check(b"crash", ExitKind::Crash);
+        check(b"", ExitKind::Ok);
+        check(b"oob", ExitKind::Crash);
+    }
+    
     #[test]
     fn test_persistent() {
         let mut forkserver = super::Forkserver::builder()
@@ -636,6 +1159,7 @@ mod tests {
                 forkserver.run_target().unwrap(),
                 code
             );
+            forkserver.last_crash().copied()
         };
         
         check(b"nothing", ExitKind::Ok);
@@ -644,13 +1168,233 @@ mod tests {
         check(b"nothing", ExitKind::Ok);
         check(b"uaf", ExitKind::Crash);
         check(b"nothing", ExitKind::Ok);
-        check(b"leak", ExitKind::Crash);
+        // Crashes that are reported with an exit code have no record
+        assert_eq!(check(b"leak", ExitKind::Crash), None);
         check(b"nothing", ExitKind::Ok);
-        check(b"null", ExitKind::Crash);
+        let null = check(b"null", ExitKind::Crash).unwrap();
         check(b"nothing", ExitKind::Ok);
-        check(b"trap", ExitKind::Crash);
+        let trap = check(b"trap", ExitKind::Crash).unwrap();
         check(b"nothing", ExitKind::Ok);
         check(b"ub", ExitKind::Crash);
+        
+        // Same crash, same signature
+        assert_eq!(check(b"null", ExitKind::Crash), Some(null));
+        assert_ne!(null.hash, trap.hash);
+    }
+    
+    #[test]
+    fn test_output_capture() {
+        let mut forkserver = super::Forkserver::builder()
+            .binary("../tests/test-persistent")
+            .env("LD_LIBRARY_PATH", "../runtime")
+            .timeout_ms(5_000)
+            .kill_signal("SIGKILL").unwrap()
+            .use_shmem(4096)
+            .capture_output(4096)
+            .spawn().unwrap();
+        
+        forkserver.input_channel_write(b"nothing");
+        assert_eq!(forkserver.run_target().unwrap(), ExitKind::Ok);
+        assert_eq!(forkserver.take_output(), None);
+        
+        forkserver.input_channel_write(b"uaf");
+        assert_eq!(forkserver.run_target().unwrap(), ExitKind::Crash);
+        let output = String::from_utf8_lossy(&forkserver.take_output().unwrap()).into_owned();
+        assert!(output.contains("AddressSanitizer"));
+        assert!(!output.contains("Doing nothing"));
+    }
+    
+    #[test]
+    fn test_output_capture_cap() {
+        let mut forkserver = super::Forkserver::builder()
+            .binary("../tests/test-persistent")
+            .env("LD_LIBRARY_PATH", "../runtime")
+            .timeout_ms(5_000)
+            .kill_signal("SIGKILL").unwrap()
+            .use_shmem(4096)
+            .capture_output(16)
+            .spawn().unwrap();
+        
+        let size = |forkserver: &super::Forkserver| forkserver.output.as_ref().unwrap().file.metadata().unwrap().len();
+        
+        forkserver.input_channel_write([b'A'; 1024]);
+        assert_eq!(forkserver.run_target().unwrap(), ExitKind::Ok);
+        assert!(size(&forkserver) > 1024);
+        
+        // The next iteration gives back what the previous one wrote beyond the tail
+        forkserver.input_channel_write(b"nothing");
+        assert_eq!(forkserver.run_target().unwrap(), ExitKind::Ok);
+        assert!(size(&forkserver) < 1024);
+    }
+    
+    #[test]
+    fn test_fork_advise() {
+        // The target checks prefaulting and the error paths itself and exits before the handshake if one fails
+        let mut forkserver = super::Forkserver::builder()
+            .binary("../tests/fork-advise")
+            .env("LD_LIBRARY_PATH", "../runtime")
+            .timeout_ms(5_000)
+            .kill_signal("SIGKILL").unwrap()
+            .debug_output(true)
+            .use_shmem(4096)
+            .spawn().unwrap();
+        
+        let mut check = |cmd: &[u8], code| {
+            forkserver.input_channel_write(cmd);
+            assert_eq!(forkserver.run_target().unwrap(), code);
+        };
+        
+        check(b"prefault", ExitKind::Ok);
+        check(b"dontfork", ExitKind::Crash);
+        check(b"nothing", ExitKind::Ok);
+    }
+    
+    #[test]
+    fn test_fork_profile() {
+        let report = std::env::temp_dir().join(format!("cheetah-fork-profile-{}.txt", std::process::id()));
+        
+        for binary in ["../tests/test-persistent", "../tests/test-forkserver"] {
+            let mut forkserver = super::Forkserver::builder()
+                .binary(binary)
+                .env("LD_LIBRARY_PATH", "../runtime")
+                .timeout_ms(5_000)
+                .kill_signal("SIGKILL").unwrap()
+                .use_shmem(4096)
+                .profile_fork(Some(&report))
+                .spawn().unwrap();
+            
+            forkserver.input_channel_write(b"nothing");
+            assert_eq!(forkserver.run_target().unwrap(), ExitKind::Ok);
+            
+            let contents = std::fs::read_to_string(&report).unwrap();
+            assert!(contents.starts_with("Fork profile:"));
+            assert!(contents.lines().any(|line| line.starts_with("anon ")));
+        }
+        
+        let _ = std::fs::remove_file(&report);
+    }
+    
+    #[test]
+    fn test_trace_events() {
+        let mut forkserver = super::Forkserver::builder()
+            .binary("../tests/test-persistent")
+            .env("LD_LIBRARY_PATH", "../runtime")
+            .timeout_ms(5_000)
+            .kill_signal("SIGKILL").unwrap()
+            .use_shmem(4096)
+            .trace_events(256)
+            .spawn().unwrap();
+        
+        for (input, code) in [(&b"nothing"[..], ExitKind::Ok), (b"null", ExitKind::Crash), (b"nothing", ExitKind::Ok)] {
+            forkserver.input_channel_write(input);
+            assert_eq!(forkserver.run_target().unwrap(), code);
+        }
+        
+        let events = forkserver.trace_events();
+        let count = |kind| events.iter().filter(|event| event.kind == kind).count();
+        
+        assert_eq!(count(TraceEventKind::RunStart), 3);
+        assert_eq!(count(TraceEventKind::RunEnd), 3);
+        assert_eq!(count(TraceEventKind::IterationStart), 3);
+        // One child for the first two inputs, a new one after the crash
+        assert_eq!(count(TraceEventKind::ForkEnd), 2);
+        assert_eq!(count(TraceEventKind::ChildExit), 1);
+        
+        let json = crate::trace_to_chrome_json(&events);
+        assert!(json.starts_with('{') && json.ends_with('}'));
+        assert!(json.contains("\"name\":\"iteration\""));
+    }
+    
+    #[test]
+    fn test_replay() {
+        let corpus = std::env::temp_dir().join(format!("cheetah-replay-{}", std::process::id()));
+        let report = corpus.with_extension("tsv");
+        std::fs::create_dir_all(&corpus).unwrap();
+        
+        for input in ["a-nothing", "b-null", "c-nothing", "d-timeout", "e-trap", "f-nothing"] {
+            std::fs::write(corpus.join(input), &input[2..]).unwrap();
+        }
+        
+        let status = Command::new("../tests/test-persistent")
+            .env("LD_LIBRARY_PATH", "../runtime")
+            .env("CHEETAH_REPLAY", &corpus)
+            .env("CHEETAH_REPLAY_REPORT", &report)
+            .env("CHEETAH_REPLAY_TIMEOUT", "1000")
+            .env("ASAN_OPTIONS", "abort_on_error=1:detect_leaks=0")
+            .stdout(Stdio::null())
+            .stderr(Stdio::null())
+            .status()
+            .unwrap();
+        assert!(status.success());
+        
+        let report = std::fs::read_to_string(&report).unwrap();
+        let statuses: Vec<&str> = report.lines().map(|line| line.split('\t').next().unwrap()).collect();
+        assert_eq!(statuses, ["ok", "crash", "ok", "timeout", "crash", "ok"]);
+        
+        let _ = std::fs::remove_dir_all(&corpus);
+    }
+    
+    #[test]
+    fn test_leak_check() {
+        let mut forkserver = super::Forkserver::builder()
+            .binary("../tests/test-leaks")
+            .env("LD_LIBRARY_PATH", "../runtime")
+            .timeout_ms(5_000)
+            .kill_signal("SIGKILL").unwrap()
+            .debug_output(true)
+            .use_shmem(4096)
+            .leak_check_interval(8)
+            .spawn().unwrap();
+        
+        for round in 0..3 {
+            for i in 0..8 {
+                let input: &[u8] = if i == round { b"leak" } else { b"nothing" };
+                forkserver.input_channel_write(input);
+                
+                if i < 7 {
+                    assert_eq!(forkserver.run_target().unwrap(), ExitKind::Ok);
+                } else {
+                    assert_eq!(forkserver.run_target().unwrap(), ExitKind::Crash);
+                    assert_eq!(forkserver.take_leaking_input().unwrap(), b"leak");
+                }
+            }
+        }
+    }
+    
+    #[test]
+    fn test_leak_check_bisect() {
+        let marker = std::env::temp_dir().join(format!("cheetah-leak-hang-{}", std::process::id()));
+        let _ = std::fs::remove_file(&marker);
+        
+        let mut forkserver = super::Forkserver::builder()
+            .binary("../tests/test-leaks")
+            .env("LD_LIBRARY_PATH", "../runtime")
+            .timeout_ms(1_000)
+            .kill_signal("SIGKILL").unwrap()
+            .debug_output(true)
+            .use_shmem(16)
+            .growable_input(4096)
+            .leak_check_interval(8)
+            .spawn().unwrap();
+        
+        // The first input hangs when the window gets bisected and
+        // the leaking one only fits after the channel has grown
+        let hang = format!("hang:{}", marker.display()).into_bytes();
+        let leak = b"leak".repeat(16);
+        let inputs: [&[u8]; 8] = [&hang, b"nothing", b"nothing", b"nothing", b"nothing", &leak, b"nothing", b"nothing"];
+        
+        for (i, input) in inputs.iter().enumerate() {
+            assert_eq!(forkserver.input_channel_write(input), input.len());
+            
+            if i < 7 {
+                assert_eq!(forkserver.run_target().unwrap(), ExitKind::Ok);
+            } else {
+                assert_eq!(forkserver.run_target().unwrap(), ExitKind::Crash);
+                assert_eq!(forkserver.take_leaking_input().unwrap(), leak);
+            }
+        }
+        
+        std::fs::remove_file(&marker).unwrap();
     }
     
     #[test]
@@ -674,6 +1418,7 @@ mod tests {
                 forkserver.run_target().unwrap(),
                 code
             );
+            forkserver.last_crash().copied()
         };
         
         check(b"nothing", ExitKind::Ok);
@@ -684,10 +1429,14 @@ mod tests {
         check(b"nothing", ExitKind::Ok);
         check(b"leak", ExitKind::Crash);
         check(b"nothing", ExitKind::Ok);
-        check(b"null", ExitKind::Crash);
+        let null = check(b"null", ExitKind::Crash).unwrap();
         check(b"nothing", ExitKind::Ok);
-        check(b"trap", ExitKind::Crash);
+        let trap = check(b"trap", ExitKind::Crash).unwrap();
         check(b"nothing", ExitKind::Ok);
         check(b"ub", ExitKind::Crash);
+        
+        // Same crash, same signature
+        assert_eq!(check(b"null", ExitKind::Crash), Some(null));
+        assert_ne!(null.hash, trap.hash);
     }
 }
@@ -93,10 +93,32 @@ impl Channel {
     }
 }
 
+/// Details about a crash that the target writes next to the status
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub(crate) struct CrashRecord {
+    pub(crate) valid: u32,
+    pub(crate) signal: i32,
+    pub(crate) fault_address: u64,
+    pub(crate) pc: u64,
+    pub(crate) hash: u64,
+}
+
+/// Tells the target which input shm is current
+#[repr(C)]
+struct InputChannelInfo {
+    generation: usize,
+    shm_id: i32,
+    limit: usize,
+}
+
 #[repr(C)]
 struct IPCChannels {
     command_channel: Channel,
     status_channel: Channel,
+    last_op: u32,
+    crash: CrashRecord,
+    input: InputChannelInfo,
 }
 
 #[derive(Debug)]
@@ -174,6 +196,36 @@ impl ForkserverIPC {
         self.channels().status_channel.recv_byte()
     }
     
+    /// Drops the record of a previous run, so that a stale record is never
+    /// attributed to a crash that did not produce one (e.g. an exit code crash)
+    pub(crate) fn clear_crash_record(&mut self) {
+        self.channels().crash.valid = 0;
+    }
+    
+    pub(crate) fn take_crash_record(&mut self) -> Option<CrashRecord> {
+        let crash = &mut self.channels().crash;
+        
+        if crash.valid == 0 {
+            return None;
+        }
+        
+        let record = *crash;
+        crash.valid = 0;
+        Some(record)
+    }
+    
+    /// Tells the target up to which size the input channel may grow
+    pub(crate) fn set_input_limit(&mut self, limit: usize) {
+        self.channels().input.limit = limit;
+    }
+    
+    /// Makes the target switch to a new input channel before the next run
+    pub(crate) fn announce_input_channel(&mut self, shm_id: i32) {
+        let input = &mut self.channels().input;
+        input.shm_id = shm_id;
+        input.generation += 1;
+    }
+    
     pub(crate) fn send_command(&mut self, cmd: u8) -> Result<(), Error> {
         #[cfg(debug_assertions)]
         self.check_op(Op::Write);
@@ -1,6 +1,10 @@
 mod compat;
 mod ipc;
 mod forkserver;
+mod netemu;
+mod trace;
 
 pub use compat::*;
 pub use forkserver::*;
+pub use netemu::*;
+pub use trace::{TraceEvent, TraceEventKind, trace_to_chrome_json};
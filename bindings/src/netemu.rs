@@ -0,0 +1,19 @@
+/// Serializes messages into the input format of the network emulation
+/// of libruntime. Every message is prefixed with its length as a
+/// native-endian `u16`, messages longer than that get split up.
+pub fn encode_messages<IT, M>(messages: IT) -> Vec<u8>
+where
+    IT: IntoIterator<Item = M>,
+    M: AsRef<[u8]>,
+{
+    let mut buffer = Vec::new();
+    
+    for message in messages {
+        for chunk in message.as_ref().chunks(u16::MAX as usize) {
+            buffer.extend_from_slice(&(chunk.len() as u16).to_ne_bytes());
+            buffer.extend_from_slice(chunk);
+        }
+    }
+    
+    buffer
+}
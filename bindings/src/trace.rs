@@ -0,0 +1,282 @@
+use libafl::prelude::Error;
+use libafl_bolts::prelude::{UnixShMem, UnixShMemProvider, ShMemProvider, ShMem};
+use std::sync::atomic::{AtomicU64, Ordering, fence};
+use std::fmt::Write;
+
+pub(crate) const TRACE_SHM_ENV_VAR: &str = "__FUZZ_TRACE_SHM";
+
+/// Kinds of events in the trace. The first block is recorded by the target,
+/// the second one by the fuzzer.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum TraceEventKind {
+    /// The target received a command, `arg` is the command
+    Command,
+    /// The target sent a status, `arg` is the status
+    Status,
+    /// The forkserver is about to fork
+    ForkStart,
+    /// The forkserver forked, `arg` is the pid of the child
+    ForkEnd,
+    /// A child started to execute an input, `arg` is the iteration in persistent mode
+    IterationStart,
+    /// A persistent child finished an input, `arg` is the iteration
+    IterationEnd,
+    /// The forkserver reaped a child, `arg` is its wait status.
+    /// In persistent mode this is the reason why a new child is forked.
+    ChildExit,
+    /// The fuzzer sends the run command
+    RunStart,
+    /// The fuzzer received the status, `arg` is the status
+    RunEnd,
+    Unknown(u32),
+}
+
+impl From<u32> for TraceEventKind {
+    fn from(value: u32) -> Self {
+        match value {
+            0 => Self::Command,
+            1 => Self::Status,
+            2 => Self::ForkStart,
+            3 => Self::ForkEnd,
+            4 => Self::IterationStart,
+            5 => Self::IterationEnd,
+            6 => Self::ChildExit,
+            16 => Self::RunStart,
+            17 => Self::RunEnd,
+            _ => Self::Unknown(value),
+        }
+    }
+}
+
+impl From<TraceEventKind> for u32 {
+    fn from(value: TraceEventKind) -> Self {
+        match value {
+            TraceEventKind::Command => 0,
+            TraceEventKind::Status => 1,
+            TraceEventKind::ForkStart => 2,
+            TraceEventKind::ForkEnd => 3,
+            TraceEventKind::IterationStart => 4,
+            TraceEventKind::IterationEnd => 5,
+            TraceEventKind::ChildExit => 6,
+            TraceEventKind::RunStart => 16,
+            TraceEventKind::RunEnd => 17,
+            TraceEventKind::Unknown(value) => value,
+        }
+    }
+}
+
+/// An event from the trace ring
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct TraceEvent {
+    /// CLOCK_MONOTONIC in nanoseconds
+    pub timestamp: u64,
+    /// Process that recorded the event
+    pub pid: u32,
+    pub kind: TraceEventKind,
+    pub arg: u64,
+}
+
+#[repr(C)]
+struct RawTraceEvent {
+    sequence: AtomicU64,
+    timestamp: u64,
+    pid: u32,
+    kind: u32,
+    arg: u64,
+}
+
+#[repr(C)]
+struct TraceRingHeader {
+    head: AtomicU64,
+    capacity: u64,
+}
+
+/// Lock-free ring of events in shared memory that is filled by the target and the fuzzer.
+/// Once it is full, the oldest events get overwritten.
+#[derive(Debug)]
+pub(crate) struct TraceRing {
+    shmem: UnixShMem,
+    pid: u32,
+}
+
+impl TraceRing {
+    pub(crate) fn new(capacity: usize) -> Result<Self, Error> {
+        let mut shmem_provider = UnixShMemProvider::new()?;
+        let mut shmem = shmem_provider.new_shmem(size_of::<TraceRingHeader>() + capacity * size_of::<RawTraceEvent>())?;
+        
+        unsafe {
+            let header = &mut *shmem.as_mut_ptr_of::<TraceRingHeader>().unwrap_unchecked();
+            header.capacity = capacity as u64;
+        }
+        
+        Ok(Self {
+            shmem,
+            pid: std::process::id(),
+        })
+    }
+    
+    /// Value for [`TRACE_SHM_ENV_VAR`] in the environment of the target
+    pub(crate) fn shm_id(&self) -> String {
+        self.shmem.id().to_string()
+    }
+    
+    #[inline(always)]
+    fn header(&self) -> &TraceRingHeader {
+        unsafe { &*self.shmem.as_ptr_of::<TraceRingHeader>().unwrap_unchecked() }
+    }
+    
+    #[inline(always)]
+    fn slot(&self, index: u64) -> *mut RawTraceEvent {
+        let capacity = self.header().capacity;
+        
+        unsafe {
+            let events = self.shmem.as_ptr().add(size_of::<TraceRingHeader>()) as *mut RawTraceEvent;
+            events.add((index % capacity) as usize)
+        }
+    }
+    
+    pub(crate) fn record(&self, kind: TraceEventKind, arg: u64) {
+        let mut now = libc::timespec { tv_sec: 0, tv_nsec: 0 };
+        unsafe {
+            libc::clock_gettime(libc::CLOCK_MONOTONIC, &mut now);
+        }
+        
+        let index = self.header().head.fetch_add(1, Ordering::Relaxed);
+        let slot = self.slot(index);
+        
+        unsafe {
+            (*slot).sequence.store(0, Ordering::Relaxed);
+            fence(Ordering::Release);
+            (&raw mut (*slot).timestamp).write_volatile(now.tv_sec as u64 * 1_000_000_000 + now.tv_nsec as u64);
+            (&raw mut (*slot).pid).write_volatile(self.pid);
+            (&raw mut (*slot).kind).write_volatile(kind.into());
+            (&raw mut (*slot).arg).write_volatile(arg);
+            (*slot).sequence.store(index + 1, Ordering::Release);
+        }
+    }
+    
+    /// Returns the events that are still in the ring, oldest first.
+    /// Events that are being overwritten while reading are skipped.
+    pub(crate) fn events(&self) -> Vec<TraceEvent> {
+        let header = self.header();
+        let head = header.head.load(Ordering::Acquire);
+        let start = head.saturating_sub(header.capacity);
+        let mut events = Vec::with_capacity((head - start) as usize);
+        
+        for index in start..head {
+            let slot = self.slot(index);
+            
+            unsafe {
+                if (*slot).sequence.load(Ordering::Acquire) != index + 1 {
+                    continue;
+                }
+                
+                let event = TraceEvent {
+                    timestamp: (&raw const (*slot).timestamp).read_volatile(),
+                    pid: (&raw const (*slot).pid).read_volatile(),
+                    kind: (&raw const (*slot).kind).read_volatile().into(),
+                    arg: (&raw const (*slot).arg).read_volatile(),
+                };
+                
+                fence(Ordering::Acquire);
+                
+                if (*slot).sequence.load(Ordering::Relaxed) == index + 1 {
+                    events.push(event);
+                }
+            }
+        }
+        
+        events
+    }
+}
+
+fn describe_wait_status(status: u64) -> String {
+    let status = status as i32;
+    
+    if libc::WIFEXITED(status) {
+        format!("exited with {}", libc::WEXITSTATUS(status))
+    } else if libc::WIFSIGNALED(status) {
+        format!("killed by signal {}", libc::WTERMSIG(status))
+    } else {
+        format!("wait status {status}")
+    }
+}
+
+/// Converts trace events into the JSON trace event format that
+/// chrome://tracing and Perfetto can open.
+/// Forks, iterations and runs of the fuzzer become slices, everything else instant events.
+pub fn trace_to_chrome_json(events: &[TraceEvent]) -> String {
+    // (forkserver, last child) pairs and processes that are inside an iteration
+    let mut children: Vec<(u32, u32)> = Vec::new();
+    let mut open_iterations: Vec<u32> = Vec::new();
+    let mut out = String::from("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    let mut first = true;
+    
+    let mut emit = |out: &mut String, name: &str, phase: char, event: &TraceEvent, pid: u32, args: Option<String>| {
+        if !first {
+            out.push(',');
+        }
+        first = false;
+        
+        let _ = write!(
+            out,
+            "{{\"name\":\"{name}\",\"ph\":\"{phase}\",\"ts\":{}.{:03},\"pid\":{pid},\"tid\":{pid}",
+            event.timestamp / 1000,
+            event.timestamp % 1000,
+        );
+        
+        if phase == 'i' {
+            out.push_str(",\"s\":\"t\"");
+        }
+        
+        if let Some(args) = args {
+            let _ = write!(out, ",\"args\":{{{args}}}");
+        }
+        
+        out.push('}');
+    };
+    
+    for event in events {
+        match event.kind {
+            TraceEventKind::ForkStart => emit(&mut out, "fork", 'B', event, event.pid, None),
+            TraceEventKind::ForkEnd => {
+                let child = event.arg as u32;
+                emit(&mut out, "fork", 'E', event, event.pid, Some(format!("\"child\":{child}")));
+                
+                children.retain(|(parent, _)| *parent != event.pid);
+                children.push((event.pid, child));
+            },
+            TraceEventKind::IterationStart => {
+                emit(&mut out, "iteration", 'B', event, event.pid, Some(format!("\"iteration\":{}", event.arg)));
+                open_iterations.push(event.pid);
+            },
+            TraceEventKind::IterationEnd => {
+                if let Some(position) = open_iterations.iter().position(|pid| *pid == event.pid) {
+                    open_iterations.swap_remove(position);
+                    emit(&mut out, "iteration", 'E', event, event.pid, None);
+                }
+            },
+            TraceEventKind::ChildExit => {
+                let reason = describe_wait_status(event.arg);
+                
+                // Children that die do not record the end of their iteration
+                if let Some((_, child)) = children.iter().find(|(parent, _)| *parent == event.pid) {
+                    if let Some(position) = open_iterations.iter().position(|pid| pid == child) {
+                        open_iterations.swap_remove(position);
+                        emit(&mut out, "iteration", 'E', event, *child, None);
+                    }
+                }
+                
+                emit(&mut out, "child exit", 'i', event, event.pid, Some(format!("\"reason\":\"{reason}\"")));
+            },
+            TraceEventKind::Command => emit(&mut out, "command", 'i', event, event.pid, Some(format!("\"command\":{}", event.arg))),
+            TraceEventKind::Status => emit(&mut out, "status", 'i', event, event.pid, Some(format!("\"status\":{}", event.arg))),
+            TraceEventKind::RunStart => emit(&mut out, "run", 'B', event, event.pid, None),
+            TraceEventKind::RunEnd => emit(&mut out, "run", 'E', event, event.pid, Some(format!("\"status\":{}", event.arg))),
+            TraceEventKind::Unknown(kind) => emit(&mut out, "unknown", 'i', event, event.pid, Some(format!("\"kind\":{kind},\"arg\":{}", event.arg))),
+        }
+    }
+    
+    out.push_str("]}");
+    out
+}
@@ -13,5 +13,43 @@ unsigned char* fuzz_input_ptr (void);
 size_t fuzz_input_len (void);
 size_t fuzz_input_max_len (void);
 size_t fuzz_input_capacity (void);
+int fuzz_input_fd (void);
+
+/*
+    Controls for the cost of the fork point. Set CHEETAH_FORK_PROFILE=1 to get
+    a report of which mappings make fork() expensive, then call fork_advise_region()
+    on them before spawn_forkserver() / spawn_persistent_loop().
+    Returns 0 on success and -1 with errno set otherwise.
+*/
+typedef enum {
+    FORK_ADVICE_DONTFORK,   // Children do not get the region at all
+    FORK_ADVICE_WIPEONFORK, // Children get zero-filled pages instead of a copy (private anonymous memory only)
+    FORK_ADVICE_PREFAULT,   // Populate the page tables now instead of faulting in every child
+} ForkAdvice;
+
+int fork_advise_region (void* addr, size_t length, ForkAdvice advice);
+
+/*
+    Fast path for harnesses that access the input in tight loops.
+    The descriptor is filled in by spawn_forkserver() / spawn_persistent_loop()
+    before the fork point and always points to a valid input, so the accessors
+    below compile down to plain memory loads that can be hoisted out of loops.
+    Without a fuzzer, they return an empty input until fuzz_input_ptr() or
+    fuzz_input_len() has been called once.
+*/
+typedef struct {
+    unsigned char* data;
+    const size_t* length;
+} FuzzInputDescriptor;
+
+extern FuzzInputDescriptor fuzz_input_descriptor;
+
+static inline unsigned char* fuzz_input_ptr_fast (void) {
+    return fuzz_input_descriptor.data;
+}
+
+static inline size_t fuzz_input_len_fast (void) {
+    return *fuzz_input_descriptor.length;
+}
 
 #endif /* __FUZZER_RUNTIME */
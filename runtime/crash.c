@@ -0,0 +1,251 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <link.h>
+#include <ucontext.h>
+
+#include "crash.h"
+#include "ipc.h"
+#include "utils.h"
+
+/*
+    Crash signatures: When the target crashes, the top frames of the stack
+    are walked via the frame pointers and every return address is hashed
+    relative to the base of its module. This gives the fuzzer a cheap way
+    to bucket crashes without symbolizing them.
+    Everything that runs inside the signal handler must be async-signal-safe.
+*/
+
+#define MAX_MODULES 128
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+typedef struct {
+    uintptr_t start;
+    uintptr_t end;
+    uintptr_t base;
+    uint64_t name_hash;
+} Module;
+
+__attribute__((weak)) int __asan_report_present (void);
+__attribute__((weak)) void* __asan_get_report_pc (void);
+__attribute__((weak)) void* __asan_get_report_bp (void);
+__attribute__((weak)) void* __asan_get_report_address (void);
+
+static Module modules[MAX_MODULES];
+static size_t num_modules = 0;
+static uintptr_t stack_end = 0;
+static volatile sig_atomic_t recorded = 0;
+static struct sigaction old_actions[NSIG];
+
+static const int crash_signals[] = {
+    SIGBUS, SIGABRT, SIGILL, SIGFPE, SIGSEGV, SIGTRAP,
+};
+
+static uint64_t hash_combine (uint64_t hash, uint64_t value) {
+    for (size_t i = 0; i < sizeof(value); ++i) {
+        hash ^= (value >> (i * 8)) & 0xFF;
+        hash *= FNV_PRIME;
+    }
+    
+    return hash;
+}
+
+static int add_module (struct dl_phdr_info* info, size_t size, void* data) {
+    (void) size;
+    (void) data;
+    uintptr_t start = UINTPTR_MAX, end = 0;
+    uint64_t name_hash = FNV_OFFSET;
+    
+    if (num_modules >= MAX_MODULES) {
+        return 1;
+    }
+    
+    for (int i = 0; i < info->dlpi_phnum; ++i) {
+        const ElfW(Phdr)* phdr = &info->dlpi_phdr[i];
+        
+        if (phdr->p_type == PT_LOAD) {
+            uintptr_t segment = info->dlpi_addr + phdr->p_vaddr;
+            
+            if (segment < start) {
+                start = segment;
+            }
+            if (segment + phdr->p_memsz > end) {
+                end = segment + phdr->p_memsz;
+            }
+        }
+    }
+    
+    // Only the file name is stable across systems
+    const char* name = info->dlpi_name ? strrchr(info->dlpi_name, '/') : NULL;
+    name = name ? name + 1 : info->dlpi_name;
+    
+    for (; name && *name; ++name) {
+        name_hash = (name_hash ^ (unsigned char) *name) * FNV_PRIME;
+    }
+    
+    if (start < end) {
+        modules[num_modules++] = (Module) {
+            .start = start,
+            .end = end,
+            .base = info->dlpi_addr,
+            .name_hash = name_hash,
+        };
+    }
+    
+    return 0;
+}
+
+static void find_stack_end (void) {
+    char line[512];
+    FILE* maps = fopen("/proc/self/maps", "r");
+    
+    if (!maps) {
+        return;
+    }
+    
+    while (fgets(line, sizeof(line), maps)) {
+        unsigned long start, end;
+        
+        if (strstr(line, "[stack]") && sscanf(line, "%lx-%lx", &start, &end) == 2) {
+            stack_end = end;
+            break;
+        }
+    }
+    
+    fclose(maps);
+}
+
+void crash_initialize (void) {
+    num_modules = 0;
+    dl_iterate_phdr(add_module, NULL);
+    find_stack_end();
+}
+
+static const Module* find_module (uintptr_t address) {
+    for (size_t i = 0; i < num_modules; ++i) {
+        if (address >= modules[i].start && address < modules[i].end) {
+            return &modules[i];
+        }
+    }
+    
+    return NULL;
+}
+
+static uint64_t hash_frame (uint64_t hash, uintptr_t address) {
+    const Module* module = find_module(address);
+    
+    // Addresses outside of known modules are not stable across runs
+    if (!module) {
+        return hash;
+    }
+    
+    hash = hash_combine(hash, module->name_hash);
+    return hash_combine(hash, address - module->base);
+}
+
+static void get_registers (void* ucontext, uintptr_t* pc, uintptr_t* fp, uintptr_t* sp) {
+    ucontext_t* uc = ucontext;
+    
+#if defined(__x86_64__)
+    *pc = uc->uc_mcontext.gregs[REG_RIP];
+    *fp = uc->uc_mcontext.gregs[REG_RBP];
+    *sp = uc->uc_mcontext.gregs[REG_RSP];
+#elif defined(__aarch64__)
+    *pc = uc->uc_mcontext.pc;
+    *fp = uc->uc_mcontext.regs[29];
+    *sp = uc->uc_mcontext.sp;
+#else
+    (void) uc;
+    *pc = 0;
+    *fp = 0;
+    *sp = 0;
+#endif
+}
+
+void crash_record_fill (int sig, siginfo_t* info, void* ucontext) {
+    volatile CrashRecord* record = ipc_crash_record();
+    uintptr_t pc, fp, sp, fault_address = (uintptr_t) info->si_addr;
+    uint64_t hash = FNV_OFFSET;
+    
+    // Only the first signal is the interesting one
+    if (!record || recorded) {
+        return;
+    }
+    
+    recorded = 1;
+    get_registers(ucontext, &pc, &fp, &sp);
+    
+    // Prefer the location of a sanitizer report over the location of its abort()
+    if (__asan_report_present && __asan_report_present() && __asan_get_report_pc()) {
+        pc = (uintptr_t) __asan_get_report_pc();
+        fp = (uintptr_t) __asan_get_report_bp();
+        fault_address = (uintptr_t) __asan_get_report_address();
+    }
+    
+    hash = hash_frame(hash, pc);
+    
+    for (size_t i = 1; i < CRASH_HASH_FRAMES; ++i) {
+        uintptr_t* frame = (uintptr_t*) fp;
+        
+        // Only follow frame pointers that point into the stack
+        if (!fp || fp % sizeof(uintptr_t) || fp < sp || fp + 2 * sizeof(uintptr_t) > stack_end) {
+            break;
+        }
+        
+        hash = hash_frame(hash, frame[1]);
+        
+        if (frame[0] <= fp) {
+            break;
+        }
+        
+        fp = frame[0];
+    }
+    
+    const Module* module = find_module(pc);
+    
+    record->signal = sig;
+    record->fault_address = fault_address;
+    record->pc = module ? pc - module->base : pc;
+    record->hash = hash;
+    __atomic_store_n(&record->valid, 1, __ATOMIC_RELEASE);
+}
+
+static void handle_crash (int sig, siginfo_t* info, void* ucontext) {
+    crash_record_fill(sig, info, ucontext);
+    
+    struct sigaction* old = &old_actions[sig];
+    
+    if (old->sa_flags & SA_SIGINFO) {
+        old->sa_sigaction(sig, info, ucontext);
+    } else if (old->sa_handler != SIG_DFL && old->sa_handler != SIG_IGN) {
+        old->sa_handler(sig);
+    } else {
+        // The handler has been reset, so this terminates the process after returning
+        raise(sig);
+    }
+}
+
+/* Records crashes and then forwards them to the handlers that were installed previously */
+int crash_install_handlers (void) {
+    sigset_t signals;
+    
+    if (sigfillset(&signals) == -1) {
+        return 1;
+    }
+    
+    struct sigaction action = (struct sigaction) {
+        .sa_sigaction = handle_crash,
+        .sa_mask = signals,
+        .sa_flags = SA_SIGINFO | SA_RESETHAND,
+        .sa_restorer = NULL,
+    };
+    
+    for (size_t i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); ++i) {
+        if (sigaction(crash_signals[i], &action, &old_actions[crash_signals[i]]) == -1) {
+            return 1;
+        }
+    }
+    
+    return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef __CRASH_H
+#define __CRASH_H
+
+#include <stdint.h>
+#include <signal.h>
+
+#define CRASH_HASH_FRAMES 8
+
+typedef struct {
+    uint32_t valid;         // set by the target, cleared by the fuzzer
+    int32_t signal;
+    uint64_t fault_address;
+    uint64_t pc;            // relative to the base of its module
+    uint64_t hash;          // hash over the top CRASH_HASH_FRAMES frames
+} CrashRecord;
+
+void crash_initialize (void);
+int crash_install_handlers (void);
+void crash_record_fill (int sig, siginfo_t* info, void* ucontext);
+
+#endif /* __CRASH_H */
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "fuzzer-runtime.h"
+
+/*
+    A main() for libFuzzer harnesses. If a fuzzer is attached, the harness
+    is executed in persistent mode. Otherwise, all files and directories
+    given on the commandline are replayed like libFuzzer would do.
+*/
+
+#define FORKSERVER_SHM_ENV_VAR "__FORKSERVER_SHM"
+
+int LLVMFuzzerTestOneInput (const unsigned char* data, size_t size);
+__attribute__((weak)) int LLVMFuzzerInitialize (int* argc, char*** argv);
+
+static long runs = 1; // executions per input
+
+static unsigned long now_ms (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+}
+
+static void run_file (const char* path) {
+    struct stat info;
+    int fd = open(path, O_RDONLY);
+    
+    if (fd < 0 || fstat(fd, &info) == -1) {
+        fprintf(stderr, "Could not open %s\n", path);
+        exit(1);
+    }
+    
+    size_t size = info.st_size;
+    size_t length = 0;
+    unsigned char* data = malloc(size ? size : 1);
+    
+    if (!data) {
+        fprintf(stderr, "Could not allocate %zu bytes for %s\n", size, path);
+        exit(1);
+    }
+    
+    while (length < size) {
+        ssize_t r = read(fd, &data[length], size - length);
+        
+        if (r <= 0) {
+            break;
+        }
+        
+        length += r;
+    }
+    
+    close(fd);
+    
+    fprintf(stderr, "Running: %s\n", path);
+    unsigned long start = now_ms();
+    
+    for (long i = 0; i < runs; ++i) {
+        LLVMFuzzerTestOneInput(data, length);
+    }
+    
+    fprintf(stderr, "Executed %s in %lu ms\n", path, now_ms() - start);
+    free(data);
+}
+
+static void run_directory (const char* path) {
+    struct dirent** entries;
+    int n = scandir(path, &entries, NULL, alphasort);
+    
+    if (n < 0) {
+        fprintf(stderr, "Could not read directory %s\n", path);
+        exit(1);
+    }
+    
+    for (int i = 0; i < n; ++i) {
+        char child[PATH_MAX];
+        struct stat info;
+        
+        snprintf(child, sizeof(child), "%s/%s", path, entries[i]->d_name);
+        
+        if (stat(child, &info) == 0 && S_ISREG(info.st_mode)) {
+            run_file(child);
+        }
+        
+        free(entries[i]);
+    }
+    
+    free(entries);
+}
+
+static int replay_inputs (int argc, char** argv) {
+    int inputs = 0;
+    
+    for (int i = 1; i < argc; ++i) {
+        struct stat info;
+        
+        if (argv[i][0] == '-') {
+            // Every other libFuzzer flag does not make sense without a fuzzer.
+            // Like libFuzzer, every input is executed at least once, so that
+            // -runs=0 still replays a corpus.
+            if (!strncmp(argv[i], "-runs=", 6)) {
+                runs = atol(&argv[i][6]);
+                runs = runs < 1 ? 1 : runs;
+            }
+            continue;
+        }
+        
+        if (stat(argv[i], &info) == -1) {
+            fprintf(stderr, "Could not find %s\n", argv[i]);
+            exit(1);
+        }
+        
+        if (S_ISDIR(info.st_mode)) {
+            run_directory(argv[i]);
+        } else {
+            run_file(argv[i]);
+        }
+        
+        inputs++;
+    }
+    
+    return inputs;
+}
+
+int main (int argc, char** argv) {
+    if (LLVMFuzzerInitialize) {
+        LLVMFuzzerInitialize(&argc, &argv);
+    }
+    
+    if (!getenv(FORKSERVER_SHM_ENV_VAR) && replay_inputs(argc, argv)) {
+        return 0;
+    }
+    
+    while (spawn_persistent_loop(MAX_ITERATIONS)) {
+        /* Like libFuzzer, hand out an exact-size copy such that ASan catches reads past the input */
+        size_t size = fuzz_input_len();
+        unsigned char* data = malloc(size);
+        
+        if (!data && size) {
+            fprintf(stderr, "Could not allocate %zu bytes for the input\n", size);
+            abort();
+        }
+        
+        memcpy(data, fuzz_input_ptr(), size);
+        LLVMFuzzerTestOneInput(data, size);
+        free(data);
+    }
+    
+    return 0;
+}
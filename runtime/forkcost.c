@@ -0,0 +1,422 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "fuzzer-runtime.h"
+#include "utils.h"
+#include "forkcost.h"
+
+#ifndef PAGE_SIZE
+#define PAGE_SIZE 4096
+#endif
+
+#ifndef MADV_WIPEONFORK
+#define MADV_WIPEONFORK 18
+#endif
+
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22
+#endif
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+/*
+    Fork-cost profiler: At the fork point, the mappings of the target are read from
+    /proc/self/smaps and grouped into classes. fork() has to copy the page tables
+    of every mapping that contains anonymous pages and write-protects those pages,
+    so every anonymous page is also a potential COW fault in the children.
+    The fork latency of a class is measured by excluding all of its mappings from
+    test forks via MADV_DONTFORK and comparing against the latency of a full fork.
+    The test children might die from a signal right away because parts of their
+    address space are missing, which does not matter since they do nothing.
+*/
+
+#define FORK_SAMPLES 31
+#define TOP_MAPPINGS 10
+
+typedef enum {
+    CLASS_TEXT,     // executable file mappings
+    CLASS_FILE,     // other private file mappings (rodata, relro, data)
+    CLASS_HEAP,
+    CLASS_STACK,
+    CLASS_ANON,     // private anonymous mappings, includes malloc arenas and sanitizer shadow
+    CLASS_SHARED,   // shared mappings like shm and memfds
+    CLASS_SPECIAL,  // vdso, vvar, vsyscall
+    NUM_CLASSES,
+} MappingClass;
+
+static const char* class_names[NUM_CLASSES] = {
+    [CLASS_TEXT] = "text",
+    [CLASS_FILE] = "file",
+    [CLASS_HEAP] = "heap",
+    [CLASS_STACK] = "stack",
+    [CLASS_ANON] = "anon",
+    [CLASS_SHARED] = "shared",
+    [CLASS_SPECIAL] = "special",
+};
+
+typedef struct {
+    unsigned long start;
+    unsigned long end;
+    char perms[5];
+    char path[128];
+    MappingClass class;
+    size_t rss;         // in kB
+    size_t anonymous;   // in kB
+    int dontfork;       // already excluded from fork
+    int wipeonfork;
+} Mapping;
+
+static Mapping* mappings = NULL;
+static size_t num_mappings = 0;
+
+static MappingClass classify (const char* perms, const char* path) {
+    if (!strcmp(path, "[heap]")) {
+        return CLASS_HEAP;
+    } else if (!strncmp(path, "[stack", 6)) {
+        return CLASS_STACK;
+    } else if (!strcmp(path, "[vdso]") || !strcmp(path, "[vvar]") || !strcmp(path, "[vvar_vclock]") || !strcmp(path, "[vsyscall]")) {
+        return CLASS_SPECIAL;
+    } else if (perms[3] == 's') {
+        return CLASS_SHARED;
+    } else if (path[0] == '/') {
+        return perms[2] == 'x' ? CLASS_TEXT : CLASS_FILE;
+    } else {
+        return CLASS_ANON;
+    }
+}
+
+static void read_smaps (void) {
+    char* line = NULL;
+    size_t capacity = 0, allocated = 0;
+    FILE* smaps = fopen("/proc/self/smaps", "r");
+    
+    if (!smaps) {
+        panic(SOURCE_FORK_PROFILE, "Could not open /proc/self/smaps");
+    }
+    
+    while (getline(&line, &capacity, smaps) > 0) {
+        unsigned long start, end;
+        char perms[5];
+        int path_offset = 0;
+        
+        if (sscanf(line, "%lx-%lx %4s %*s %*s %*s %n", &start, &end, perms, &path_offset) >= 3 && path_offset > 0) {
+            if (num_mappings == allocated) {
+                allocated = allocated ? allocated * 2 : 256;
+                mappings = realloc(mappings, allocated * sizeof(Mapping));
+                
+                if (!mappings) {
+                    panic(SOURCE_FORK_PROFILE, "Could not allocate mappings");
+                }
+            }
+            
+            Mapping* mapping = &mappings[num_mappings++];
+            memset(mapping, 0, sizeof(*mapping));
+            mapping->start = start;
+            mapping->end = end;
+            memcpy(mapping->perms, perms, sizeof(perms));
+            snprintf(mapping->path, sizeof(mapping->path), "%s", &line[path_offset]);
+            mapping->path[strcspn(mapping->path, "\n")] = 0;
+            mapping->class = classify(mapping->perms, mapping->path);
+        } else if (num_mappings > 0) {
+            Mapping* mapping = &mappings[num_mappings - 1];
+            
+            if (!strncmp(line, "Rss:", 4)) {
+                mapping->rss = strtoul(&line[4], NULL, 10);
+            } else if (!strncmp(line, "Anonymous:", 10)) {
+                mapping->anonymous = strtoul(&line[10], NULL, 10);
+            } else if (!strncmp(line, "VmFlags:", 8)) {
+                mapping->dontfork = strstr(line, " dc") != NULL;
+                mapping->wipeonfork = strstr(line, " wf") != NULL;
+            }
+        }
+    }
+    
+    free(line);
+    fclose(smaps);
+}
+
+static unsigned long fork_latency (void) {
+    unsigned long samples[FORK_SAMPLES];
+    
+    for (size_t i = 0; i < FORK_SAMPLES; ++i) {
+        struct timespec start, end;
+        
+        clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+        pid_t child = fork();
+        clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+        
+        if (child < 0) {
+            panic(SOURCE_FORK_PROFILE, "Could not fork");
+        } else if (child == 0) {
+            _exit(0);
+        }
+        
+        if (waitpid(child, NULL, 0) != child) {
+            panic(SOURCE_FORK_PROFILE, "Waitpid failed");
+        }
+        
+        samples[i] = (end.tv_sec - start.tv_sec) * 1000000000UL + end.tv_nsec - start.tv_nsec;
+    }
+    
+    // Median via insertion sort
+    for (size_t i = 1; i < FORK_SAMPLES; ++i) {
+        for (size_t j = i; j > 0 && samples[j - 1] > samples[j]; --j) {
+            unsigned long tmp = samples[j];
+            samples[j] = samples[j - 1];
+            samples[j - 1] = tmp;
+        }
+    }
+    
+    return samples[FORK_SAMPLES / 2];
+}
+
+/* Returns the fork latency in ns without the mappings of the given class or -1 if they cannot be excluded */
+static long class_latency (MappingClass class) {
+    long latency;
+    size_t excluded = 0;
+    
+    if (class == CLASS_STACK || class == CLASS_SPECIAL) {
+        return -1;
+    }
+    
+    for (size_t i = 0; i < num_mappings; ++i) {
+        Mapping* mapping = &mappings[i];
+        
+        if (mapping->class == class && !mapping->dontfork) {
+            if (madvise((void*) mapping->start, mapping->end - mapping->start, MADV_DONTFORK) == 0) {
+                mapping->dontfork = -1;
+                excluded++;
+            }
+        }
+    }
+    
+    if (!excluded) {
+        return -1;
+    }
+    
+    latency = fork_latency();
+    
+    for (size_t i = 0; i < num_mappings; ++i) {
+        Mapping* mapping = &mappings[i];
+        
+        if (mapping->dontfork == -1) {
+            madvise((void*) mapping->start, mapping->end - mapping->start, MADV_DOFORK);
+            mapping->dontfork = 0;
+        }
+    }
+    
+    return latency;
+}
+
+static int compare_anonymous (const void* a, const void* b) {
+    const Mapping* x = a;
+    const Mapping* y = b;
+    
+    if (x->anonymous != y->anonymous) {
+        return x->anonymous < y->anonymous ? 1 : -1;
+    }
+    
+    return x->rss < y->rss ? 1 : (x->rss > y->rss ? -1 : 0);
+}
+
+void fork_cost_profile (void) {
+    struct rlimit old_core, no_core;
+    int fd = 2;
+    char* value = getenv(FORK_PROFILE_ENV_VAR);
+    
+    if (!value) {
+        return;
+    }
+    
+    value = getenv(FORK_PROFILE_REPORT_ENV_VAR);
+    
+    if (value) {
+        fd = open(value, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        
+        if (fd < 0) {
+            panic(SOURCE_FORK_PROFILE, "Could not open report file");
+        }
+    }
+    
+    // Test children that lost parts of their address space must not dump core
+    if (getrlimit(RLIMIT_CORE, &old_core) == -1) {
+        panic(SOURCE_FORK_PROFILE, "Could not get core dump limit");
+    }
+    
+    no_core = (struct rlimit) {
+        .rlim_cur = 0,
+        .rlim_max = old_core.rlim_max,
+    };
+    
+    if (setrlimit(RLIMIT_CORE, &no_core) == -1) {
+        panic(SOURCE_FORK_PROFILE, "Could not disable core dumps");
+    }
+    
+    read_smaps();
+    
+    // The first forks are slower because the kernel structures are cold
+    fork_latency();
+    unsigned long total = fork_latency();
+    
+    dprintf(fd, "Fork profile: %zu mappings, fork latency %lu us\n", num_mappings, total / 1000);
+    dprintf(fd, "%-8s %6s %12s %12s %12s %10s\n", "class", "maps", "size_kb", "rss_kb", "anon_kb", "fork_us");
+    
+    for (MappingClass class = 0; class < NUM_CLASSES; ++class) {
+        size_t count = 0, size = 0, rss = 0, anonymous = 0;
+        
+        for (size_t i = 0; i < num_mappings; ++i) {
+            if (mappings[i].class == class) {
+                count++;
+                size += (mappings[i].end - mappings[i].start) / 1024;
+                rss += mappings[i].rss;
+                anonymous += mappings[i].anonymous;
+            }
+        }
+        
+        if (!count) {
+            continue;
+        }
+        
+        long without = class_latency(class);
+        
+        if (without < 0) {
+            dprintf(fd, "%-8s %6zu %12zu %12zu %12zu %10s\n", class_names[class], count, size, rss, anonymous, "-");
+        } else {
+            long delta = (long) total - without;
+            dprintf(fd, "%-8s %6zu %12zu %12zu %12zu %10ld\n", class_names[class], count, size, rss, anonymous, (delta > 0 ? delta : 0) / 1000);
+        }
+    }
+    
+    // Anonymous pages are copied into the page tables of every child and fault when written
+    qsort(mappings, num_mappings, sizeof(Mapping), compare_anonymous);
+    
+    dprintf(fd, "Largest mappings by anonymous memory (page-table copy and COW exposure):\n");
+    
+    for (size_t i = 0; i < num_mappings && i < TOP_MAPPINGS && mappings[i].anonymous > 0; ++i) {
+        Mapping* mapping = &mappings[i];
+        
+        dprintf(fd, "  %012lx-%012lx %s %-7s anon_kb=%zu rss_kb=%zu%s%s %s\n",
+            mapping->start, mapping->end, mapping->perms, class_names[mapping->class],
+            mapping->anonymous, mapping->rss,
+            mapping->dontfork ? " dontfork" : "", mapping->wipeonfork ? " wipeonfork" : "",
+            mapping->path
+        );
+    }
+    
+    free(mappings);
+    mappings = NULL;
+    num_mappings = 0;
+    
+    if (setrlimit(RLIMIT_CORE, &old_core) == -1) {
+        panic(SOURCE_FORK_PROFILE, "Could not restore core dump limit");
+    }
+    
+    if (fd != 2) {
+        close(fd);
+    }
+}
+
+static int populate (unsigned long start, unsigned long end, int writable) {
+    if (madvise((void*) start, end - start, writable ? MADV_POPULATE_WRITE : MADV_POPULATE_READ) == 0) {
+        return 0;
+    } else if (errno != EINVAL) {
+        return -1;
+    }
+    
+    // Kernels before 5.14 have no MADV_POPULATE_*.
+    // Private writable pages only become the target's own pages when they are written.
+    for (unsigned long page = start; page < end; page += PAGE_SIZE) {
+        if (writable) {
+            __atomic_fetch_or((unsigned char*) page, 0, __ATOMIC_RELAXED);
+        } else {
+            (void) *(volatile unsigned char*) page;
+        }
+    }
+    
+    return 0;
+}
+
+/* Populates [start, end) mapping by mapping because the right kind of population depends on the permissions */
+static int prefault (unsigned long start, unsigned long end) {
+    char* line = NULL;
+    size_t capacity = 0;
+    unsigned long next = start;
+    int ret = 0;
+    FILE* maps = fopen("/proc/self/maps", "r");
+    
+    if (!maps) {
+        return -1;
+    }
+    
+    while (next < end && getline(&line, &capacity, maps) > 0) {
+        unsigned long map_start, map_end;
+        char perms[5];
+        
+        if (sscanf(line, "%lx-%lx %4s", &map_start, &map_end, perms) != 3 || map_end <= next) {
+            continue;
+        }
+        
+        if (map_start > next) {
+            // Same error as madvise() for unmapped memory
+            errno = ENOMEM;
+            ret = -1;
+            break;
+        } else if (perms[0] != 'r') {
+            errno = EINVAL;
+            ret = -1;
+            break;
+        }
+        
+        unsigned long stop = map_end < end ? map_end : end;
+        
+        if (populate(next, stop, perms[1] == 'w' && perms[3] == 'p')) {
+            ret = -1;
+            break;
+        }
+        
+        next = stop;
+    }
+    
+    if (ret == 0 && next < end) {
+        errno = ENOMEM;
+        ret = -1;
+    }
+    
+    int saved_errno = errno;
+    free(line);
+    fclose(maps);
+    errno = saved_errno;
+    return ret;
+}
+
+VISIBLE
+int fork_advise_region (void* addr, size_t length, ForkAdvice advice) {
+    unsigned long start = (unsigned long) addr & ~(PAGE_SIZE - 1UL);
+    unsigned long end = ((unsigned long) addr + length + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1UL);
+    
+    switch (advice) {
+        case FORK_ADVICE_DONTFORK: {
+            return madvise((void*) start, end - start, MADV_DONTFORK);
+        }
+        case FORK_ADVICE_WIPEONFORK: {
+            return madvise((void*) start, end - start, MADV_WIPEONFORK);
+        }
+        case FORK_ADVICE_PREFAULT: {
+            return prefault(start, end);
+        }
+    }
+    
+    errno = EINVAL;
+    return -1;
+}
@@ -0,0 +1,9 @@
+#ifndef __FORKCOST_H
+#define __FORKCOST_H
+
+#define FORK_PROFILE_ENV_VAR "CHEETAH_FORK_PROFILE"
+#define FORK_PROFILE_REPORT_ENV_VAR "CHEETAH_FORK_PROFILE_REPORT"
+
+void fork_cost_profile (void);
+
+#endif /* __FORKCOST_H */
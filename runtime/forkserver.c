@@ -9,6 +9,10 @@
 #include "utils.h"
 #include "ipc.h"
 #include "input.h"
+#include "crash.h"
+#include "output.h"
+#include "forkcost.h"
+#include "trace.h"
 
 int started = 0;
 
@@ -23,9 +27,20 @@ int forkserver_handshake (ForkserverMode mode, ForkserverConfig* config) {
     
     ipc_recv_exact(config, sizeof(*config));
     
+    // Attach to the input channel before the fork point. This has to happen before
+    // the handshake completes because the fuzzer may replace the channel right after.
+    fuzz_input_prepare();
+    
     unsigned char accept = 1;
     ipc_send_exact(&accept, sizeof(accept));
     
+    // Attach to the event ring before the first command so that the forkserver
+    // and every child it forks record into the same ring
+    trace_initialize();
+    
+    output_capture_prepare();
+    crash_initialize();
+    
     return 0;
 }
 
@@ -74,6 +89,7 @@ static unsigned char wait_for_child (ForkserverConfig* config, pid_t child, sigs
         if (waitpid(child, &status, 0) != child) {
             panic(SOURCE_FORKSERVER, "Waitpid for SIGCHLD failed");
         }
+        trace_event(TRACE_CHILD_EXIT, status);
         return convert_status(config, status);
     } else {
         panic(SOURCE_FORKSERVER, "Invalid return code from sigtimedwait");
@@ -92,7 +108,10 @@ void spawn_forkserver (void) {
     
     started = 1;
     
-    if (sigemptyset(&signals) == -1 ||
+    fork_cost_profile();
+    
+    if (crash_install_handlers() ||
+        sigemptyset(&signals) == -1 ||
         sigaddset(&signals, SIGCHLD) == -1 ||
         sigprocmask(SIG_BLOCK, &signals, NULL) == -1
     ) {
@@ -112,13 +131,20 @@ void spawn_forkserver (void) {
                 _Exit(0);
             }
             case COMMAND_RUN: {
+                fuzz_input_refresh();
+                
+                trace_event(TRACE_FORK_START, 0);
                 pid_t child = fork();
                 
                 if (child < 0) {
                     panic(SOURCE_FORKSERVER, "Could not fork");
                 } else if (child == 0) {
+                    fuzz_input_rewind();
+                    output_capture_rewind();
+                    trace_event(TRACE_ITERATION_START, 0);
                     return;
                 } else {
+                    trace_event(TRACE_FORK_END, child);
                     unsigned char c = wait_for_child(&config, child, &signals, &timeout);
                     ipc_send_status(c);
                 }
@@ -4,7 +4,7 @@
 #include <signal.h>
 
 #define FORKSERVER_MAGIC 0xDEAD0000
-#define FORKSERVER_VERSION 1
+#define FORKSERVER_VERSION 2
 
 typedef enum {
     MODE_FORKSERVER = 1,
@@ -21,6 +21,7 @@ typedef enum {
     STATUS_EXIT = 0,
     STATUS_CRASH = 1,
     STATUS_TIMEOUT = 2,
+    STATUS_LEAK = 3,
 } ForkserverStatus;
 
 typedef enum {
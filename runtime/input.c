@@ -1,14 +1,20 @@
 #define _GNU_SOURCE
 #define __USE_GNU
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/shm.h>
 #include <sys/mman.h>
+#include <sys/types.h>
 
 #include "fuzzer-runtime.h"
 #include "utils.h"
+#include "input.h"
+#include "ipc.h"
 
 #define FUZZ_INPUT_SHM_ENV_VAR "__FUZZ_INPUT_SHM"
+#define FUZZ_INPUT_FD_ENV_VAR "__FUZZ_INPUT_FD"
 
 #ifndef PAGE_SIZE
 #define PAGE_SIZE 4096
@@ -21,7 +27,19 @@ typedef struct {
 } FuzzInput;
 
 static volatile FuzzInput* shm = NULL;
-static int is_stdin = 0;
+static unsigned char* data = NULL;
+static int is_local = 0; // input does not come from a fuzzer
+static int input_fd = -1;
+static int shm_id = -1;
+static size_t mapped_length = 0; // length of the memfd mapping
+static size_t generation = 0; // of the input channel, see fuzz_input_refresh()
+static FuzzInput empty_input; // what the fast path sees while there is no input
+
+VISIBLE
+FuzzInputDescriptor fuzz_input_descriptor = {
+    .data = empty_input.data,
+    .length = &empty_input.length,
+};
 
 static unsigned char* consume_stdin (size_t* final_length, size_t* final_max_length) {
     size_t length = sizeof(FuzzInput);
@@ -43,7 +61,7 @@ static unsigned char* consume_stdin (size_t* final_length, size_t* final_max_len
             break;
         } else {
             length += r;
-            capacity += PAGE_SIZE;
+            capacity *= 2;
             buffer = mremap(buffer, length, capacity, MREMAP_MAYMOVE);
             
             if (!buffer || buffer == (void*) -1) {
@@ -57,30 +75,197 @@ static unsigned char* consume_stdin (size_t* final_length, size_t* final_max_len
     return buffer;
 }
 
+static void publish_descriptor (void) {
+    if (shm) {
+        fuzz_input_descriptor.data = data;
+        fuzz_input_descriptor.length = (const size_t*) &shm->length;
+    } else {
+        fuzz_input_descriptor.data = empty_input.data;
+        fuzz_input_descriptor.length = &empty_input.length;
+    }
+}
+
 static void fuzz_input_initialize (void) {
     char* value = getenv(FUZZ_INPUT_SHM_ENV_VAR);
     
     if (value) {
         /* Use shm as input */
-        int id = atoi(value);
-        shm = (volatile FuzzInput*) shmat(id, NULL, 0);
+        shm_id = atoi(value);
+        shm = (volatile FuzzInput*) shmat(shm_id, NULL, 0);
         if (!shm || shm == (void*) -1) {
             panic(SOURCE_FUZZ_INPUT, "Could not attach to shm");
         }
+        
+        value = getenv(FUZZ_INPUT_FD_ENV_VAR);
+        
+        if (value) {
+            /* Data lives in a memfd, the shm only holds the metadata */
+            input_fd = atoi(value);
+            mapped_length = shm->max_length;
+            data = mmap(NULL, mapped_length, PROT_READ | PROT_WRITE, MAP_SHARED, input_fd, 0);
+            if (!data || data == (void*) -1) {
+                panic(SOURCE_FUZZ_INPUT, "Could not mmap input memfd");
+            }
+            
+            fuzz_input_rewind();
+        } else {
+            data = (unsigned char*) &shm->data[0];
+        }
     } else {
         /* Use stdin as input */
         size_t input_len = 0, max_len = 0;
         shm = (volatile FuzzInput*) consume_stdin(&input_len, &max_len);
         shm->length = input_len;
         shm->max_length = max_len;
-        is_stdin = 1;
+        data = (unsigned char*) &shm->data[0];
+        is_local = 1;
+    }
+    
+    publish_descriptor();
+}
+
+static void fill_memfd (void) {
+    size_t written = 0;
+    
+    if (input_fd < 0) {
+        input_fd = memfd_create("fuzz-input", 0);
+        if (input_fd < 0) {
+            panic(SOURCE_FUZZ_INPUT, "Could not create memfd");
+        }
+    } else if (ftruncate(input_fd, 0) == -1) {
+        panic(SOURCE_FUZZ_INPUT, "Could not truncate memfd");
+    }
+    
+    fuzz_input_rewind();
+    
+    while (written < shm->length) {
+        ssize_t r = write(input_fd, &data[written], shm->length - written);
+        
+        if (r < 0) {
+            panic(SOURCE_FUZZ_INPUT, "Could not write to memfd");
+        }
+        
+        written += r;
+    }
+    
+    fuzz_input_rewind();
+}
+
+void fuzz_input_rewind (void) {
+    if (input_fd == 0) {
+        /* Also drop what stdio buffered and the EOF flag from the last iteration */
+        if (fseek(stdin, 0, SEEK_SET) == -1) {
+            panic(SOURCE_FUZZ_INPUT, "Could not rewind stdin");
+        }
+        
+        clearerr(stdin);
+    } else if (input_fd >= 0 && lseek(input_fd, 0, SEEK_SET) == -1) {
+        panic(SOURCE_FUZZ_INPUT, "Could not rewind input fd");
+    }
+}
+
+void fuzz_input_set (unsigned char* buffer, size_t length) {
+    static FuzzInput local_header;
+    
+    if (shm && !is_local) {
+        panic(SOURCE_FUZZ_INPUT, "Cannot replace input from fuzzer");
+    }
+    
+    shm = &local_header;
+    shm->length = length;
+    shm->max_length = length;
+    data = buffer;
+    is_local = 1;
+    publish_descriptor();
+    
+    if (input_fd >= 0) {
+        fill_memfd();
+    }
+}
+
+/* Overwrites the input in the input channel, e.g. to report an input back to the fuzzer */
+void fuzz_input_replace (const unsigned char* buffer, size_t length) {
+    if (!shm) {
+        fuzz_input_initialize();
+    }
+    
+    if (length > shm->max_length) {
+        length = shm->max_length;
+    }
+    
+    if (input_fd >= 0 && !is_local && ftruncate(input_fd, length) == -1) {
+        panic(SOURCE_FUZZ_INPUT, "Could not resize input memfd");
+    }
+    
+    memmove(data, buffer, length);
+    shm->length = length;
+    
+    if (input_fd >= 0 && is_local) {
+        fill_memfd();
     }
 }
 
+void fuzz_input_prepare (void) {
+    if (!shm && getenv(FUZZ_INPUT_SHM_ENV_VAR)) {
+        fuzz_input_initialize();
+    }
+}
+
+/* Whether the input channel of a fuzzer is attached */
+int fuzz_input_from_fuzzer (void) {
+    return shm && !is_local;
+}
+
+/*
+    The fuzzer grows the input channel by replacing it with a larger shm (or by enlarging
+    the memfd) and incrementing the generation in the IPC shm. Processes follow lazily after
+    they received a command, so the forkserver does it before forking its children.
+*/
+void fuzz_input_refresh (void) {
+    volatile InputChannelInfo* info = ipc_input_info();
+    
+    if (!shm || is_local || !info || info->generation == generation) {
+        return;
+    }
+    
+    generation = info->generation;
+    
+    if (info->shm_id != shm_id) {
+        volatile FuzzInput* new_shm = (volatile FuzzInput*) shmat(info->shm_id, NULL, 0);
+        if (!new_shm || new_shm == (void*) -1) {
+            panic(SOURCE_FUZZ_INPUT, "Could not attach to new input shm");
+        }
+        
+        shmdt((void*) shm);
+        shm = new_shm;
+        shm_id = info->shm_id;
+        
+        if (input_fd < 0) {
+            data = (unsigned char*) &shm->data[0];
+        }
+    }
+    
+    if (input_fd >= 0 && mapped_length != shm->max_length) {
+        munmap(data, mapped_length);
+        mapped_length = shm->max_length;
+        data = mmap(NULL, mapped_length, PROT_READ | PROT_WRITE, MAP_SHARED, input_fd, 0);
+        if (!data || data == (void*) -1) {
+            panic(SOURCE_FUZZ_INPUT, "Could not mmap input memfd");
+        }
+    }
+    
+    publish_descriptor();
+}
+
 void fuzz_input_cleanup (void) {
-    if (shm && !is_stdin) {
+    if (shm && !is_local) {
+        if (input_fd >= 0) {
+            munmap(data, mapped_length);
+        }
         shmdt((void*) shm);
         shm = NULL;
+        data = NULL;
+        publish_descriptor();
     }
 }
 
@@ -90,7 +275,7 @@ unsigned char* fuzz_input_ptr (void) {
         fuzz_input_initialize();
     }
     
-    return (unsigned char*) &shm->data[0];
+    return data;
 }
 
 VISIBLE
@@ -125,3 +310,16 @@ size_t fuzz_input_capacity (void) {
     
     return total_length;
 }
+
+VISIBLE
+int fuzz_input_fd (void) {
+    if (!shm) {
+        fuzz_input_initialize();
+    }
+    
+    if (input_fd < 0 && is_local) {
+        fill_memfd();
+    }
+    
+    return input_fd;
+}
@@ -1,6 +1,21 @@
 #ifndef __INPUT_H
 #define __INPUT_H
 
+#include <stddef.h>
+
+/* Written by the fuzzer whenever it replaces the input channel with a larger one */
+typedef struct {
+    size_t generation;      // incremented on every replacement
+    int shm_id;             // id of the current input shm
+    size_t limit;           // size up to which the channel may grow, 0 if unknown
+} InputChannelInfo;
+
+void fuzz_input_rewind (void);
+void fuzz_input_set (unsigned char* buffer, size_t length);
+void fuzz_input_replace (const unsigned char* buffer, size_t length);
+void fuzz_input_prepare (void);
+int fuzz_input_from_fuzzer (void);
+void fuzz_input_refresh (void);
 void fuzz_input_cleanup (void);
 
 #endif /* __INPUT_H */
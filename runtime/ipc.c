@@ -6,6 +6,7 @@
 
 #include "utils.h"
 #include "ipc.h"
+#include "trace.h"
 
 #define FORKSERVER_SHM_ENV_VAR "__FORKSERVER_SHM"
 #define MAX_MESSAGE_SIZE 64
@@ -26,6 +27,8 @@ typedef struct {
     Channel command_channel; // fuzzer -> target
     Channel status_channel;  // target -> fuzzer
     IpcOp last_op;           // last operation the target did
+    CrashRecord crash;       // details about the last crash
+    InputChannelInfo input;  // current input channel
 } Ipc;
 
 static volatile Ipc* shm = NULL;
@@ -47,6 +50,14 @@ int ipc_init (void) {
     return 0;
 }
 
+volatile CrashRecord* ipc_crash_record (void) {
+    return shm ? &shm->crash : NULL;
+}
+
+volatile InputChannelInfo* ipc_input_info (void) {
+    return shm ? &shm->input : NULL;
+}
+
 void ipc_cleanup (void) {
     if (shm) {
         shmdt((void*) shm);
@@ -114,7 +125,9 @@ unsigned char ipc_recv_command (void) {
     }
 #endif
     
-    return shm->command_channel.message[0];
+    unsigned char command = shm->command_channel.message[0];
+    trace_event(TRACE_COMMAND, command);
+    return command;
 }
 
 void ipc_send_status (unsigned char status) {
@@ -127,6 +140,7 @@ void ipc_send_status (unsigned char status) {
 #endif
 
     shm->status_channel.message[0] = status;
+    trace_event(TRACE_STATUS, status);
     
     while (sem_post((sem_t*) &shm->status_channel.semaphore) == -1) {
         if (errno != EINTR) {
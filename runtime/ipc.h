@@ -1,11 +1,18 @@
 #ifndef __IPC_H
 #define __IPC_H
 
+#include <stddef.h>
+
+#include "crash.h"
+#include "input.h"
+
 int ipc_init (void);
 void ipc_send_exact (void* buffer, size_t length);
 void ipc_recv_exact (void* buffer, size_t length);
 unsigned char ipc_recv_command (void);
 void ipc_send_status (unsigned char status);
+volatile CrashRecord* ipc_crash_record (void);
+volatile InputChannelInfo* ipc_input_info (void);
 void ipc_cleanup (void);
 
 #endif /* __IPC_H */
@@ -0,0 +1,117 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "fuzzer-runtime.h"
+#include "utils.h"
+#include "input.h"
+#include "ipc.h"
+#include "leaks.h"
+
+/*
+    Batched leak detection: Instead of detecting leaks only when a persistent
+    child exits, LeakSanitizer is invoked every N iterations. The last N inputs
+    are kept in a window that is shared with the persistent parent such that
+    it can find the input that caused a leak after the child is gone.
+    The slots are large enough for the biggest input that the fuzzer may grow
+    the input channel to, but only the pages that are used get populated.
+*/
+
+__attribute__((weak)) int __lsan_do_recoverable_leak_check (void);
+
+typedef struct {
+    int leak_found;
+    size_t count;
+    size_t lengths[];
+} LeakWindow;
+
+static size_t interval = 0;
+static size_t slot_size = 0;
+static volatile LeakWindow* window = NULL;
+static unsigned char* slots = NULL;
+
+int leak_check_initialize (void) {
+    char* value = getenv(LEAK_CHECK_INTERVAL_ENV_VAR);
+    
+    if (!value || !__lsan_do_recoverable_leak_check || !fuzz_input_from_fuzzer()) {
+        return 0;
+    }
+    
+    interval = strtoul(value, NULL, 0);
+    
+    if (interval == 0) {
+        return 0;
+    }
+    
+    volatile InputChannelInfo* info = ipc_input_info();
+    slot_size = fuzz_input_max_len();
+    
+    if (info && info->limit > slot_size) {
+        slot_size = info->limit;
+    }
+    
+    size_t header_size = sizeof(LeakWindow) + interval * sizeof(size_t);
+    size_t total_size = header_size + interval * slot_size;
+    unsigned char* buffer = mmap(NULL, total_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    
+    if (!buffer || buffer == (void*) -1) {
+        panic(SOURCE_PERSISTENT, "Could not mmap leak window");
+    }
+    
+    window = (volatile LeakWindow*) buffer;
+    slots = &buffer[header_size];
+    return 1;
+}
+
+void leak_check_reset (void) {
+    if (window) {
+        window->leak_found = 0;
+        window->count = 0;
+    }
+}
+
+void leak_check_record (void) {
+    if (window) {
+        size_t length = fuzz_input_len();
+        
+        if (length > slot_size) {
+            length = slot_size;
+        }
+        
+        memcpy(&slots[window->count * slot_size], fuzz_input_ptr(), length);
+        window->lengths[window->count] = length;
+        window->count += 1;
+    }
+}
+
+int leak_check_run (void) {
+    return __lsan_do_recoverable_leak_check() != 0;
+}
+
+/* Returns whether a leak was found in the current window */
+int leak_check_iteration_end (int force) {
+    if (!window || window->count == 0 || (!force && window->count < interval)) {
+        return 0;
+    }
+    
+    if (leak_check_run()) {
+        window->leak_found = 1;
+        return 1;
+    }
+    
+    window->count = 0;
+    return 0;
+}
+
+int leak_check_pending (void) {
+    return window && window->leak_found;
+}
+
+size_t leak_window_size (void) {
+    return window->count;
+}
+
+void leak_window_load (size_t index) {
+    fuzz_input_replace(&slots[index * slot_size], window->lengths[index]);
+}
@@ -0,0 +1,17 @@
+#ifndef __LEAKS_H
+#define __LEAKS_H
+
+#include <stddef.h>
+
+#define LEAK_CHECK_INTERVAL_ENV_VAR "CHEETAH_LEAK_CHECK_INTERVAL"
+
+int leak_check_initialize (void);
+void leak_check_reset (void);
+void leak_check_record (void);
+int leak_check_iteration_end (int force);
+int leak_check_run (void);
+int leak_check_pending (void);
+size_t leak_window_size (void);
+void leak_window_load (size_t index);
+
+#endif /* __LEAKS_H */
@@ -0,0 +1,586 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "fuzzer-runtime.h"
+#include "utils.h"
+
+#define NETEMU_PORT_ENV_VAR "CHEETAH_NETEMU_PORT"
+// Sockets with higher descriptors are never emulated
+#define MAX_TRACKED_FDS 1024
+
+// Not using _GNU_SOURCE because it changes the prototypes of the socket functions
+#ifndef RTLD_NEXT
+#define RTLD_NEXT ((void*) -1L)
+#endif
+
+#define RESOLVE(var, name) *(void**) &(var) = resolve(name)
+
+/*
+    Network emulation: The listening socket that is bound to the port
+    in CHEETAH_NETEMU_PORT never touches the network stack. Every accept()
+    on it starts a new iteration of the persistent loop and hands out a
+    connection that serves the fuzz input.
+    The fuzz input is a sequence of messages, each prefixed with its length
+    as a native-endian uint16_t. A single read never crosses a message boundary.
+    Everything the target sends to the client is discarded.
+    This is built into its own libnetemu.so that gets preloaded into network
+    targets only, such that the I/O of all other targets is not routed through here.
+    It depends on libruntime.so for the persistent loop and the fuzz input.
+*/
+
+typedef uint16_t MessageLength;
+
+static int netemu_port = -1;
+static int listen_fd = -1;
+static int listen_domain = AF_INET;
+static int client_fd = -1;
+static int connected = 0;
+static size_t cursor = 0;
+static size_t message_remaining = 0;
+static unsigned char stream_sockets[MAX_TRACKED_FDS / 8];
+
+static ssize_t (*real_read) (int, void*, size_t);
+static ssize_t (*real_write) (int, const void*, size_t);
+static ssize_t (*real_recvfrom) (int, void*, size_t, int, struct sockaddr*, socklen_t*);
+static ssize_t (*real_sendto) (int, const void*, size_t, int, const struct sockaddr*, socklen_t);
+static int (*real_close) (int);
+static int (*real_poll) (struct pollfd*, nfds_t, int);
+static int (*real_socket) (int, int, int);
+
+/* The internal panic() of libruntime.so is not exported, so this mirrors it */
+__attribute__((noreturn))
+static void netemu_panic (const char* message) {
+    fprintf(stderr, "Network emulation runtime failure: %s (errno=\"%s\")\n", message, strerror(errno));
+    fflush(stderr);
+    abort();
+}
+
+static void* resolve (const char* name) {
+    void* sym = dlsym(RTLD_NEXT, name);
+    
+    if (!sym) {
+        netemu_panic("Could not resolve libc function");
+    }
+    
+    return sym;
+}
+
+__attribute__((constructor))
+static void netemu_initialize (void) {
+    if (real_read) {
+        return;
+    }
+    
+    RESOLVE(real_read, "read");
+    RESOLVE(real_write, "write");
+    RESOLVE(real_recvfrom, "recvfrom");
+    RESOLVE(real_sendto, "sendto");
+    RESOLVE(real_close, "close");
+    RESOLVE(real_poll, "poll");
+    RESOLVE(real_socket, "socket");
+    
+    char* value = getenv(NETEMU_PORT_ENV_VAR);
+    
+    if (value) {
+        netemu_port = atoi(value);
+    }
+}
+
+static inline int is_client (int fd) {
+    return fd >= 0 && fd == client_fd;
+}
+
+static inline int is_listener (int fd) {
+    return fd >= 0 && fd == listen_fd;
+}
+
+static inline int is_stream_socket (int fd) {
+    return fd >= 0 && fd < MAX_TRACKED_FDS && (stream_sockets[fd / 8] & (1 << (fd % 8)));
+}
+
+static inline void track_stream_socket (int fd, int is_stream) {
+    if (fd >= 0 && fd < MAX_TRACKED_FDS) {
+        if (is_stream) {
+            stream_sockets[fd / 8] |= 1 << (fd % 8);
+        } else {
+            stream_sockets[fd / 8] &= ~(1 << (fd % 8));
+        }
+    }
+}
+
+static void next_message (void) {
+    size_t length = fuzz_input_len();
+    MessageLength header;
+    
+    if (cursor + sizeof(header) > length) {
+        cursor = length;
+        message_remaining = 0;
+        return;
+    }
+    
+    memcpy(&header, fuzz_input_ptr() + cursor, sizeof(header));
+    cursor += sizeof(header);
+    message_remaining = header;
+    
+    if (message_remaining > length - cursor) {
+        message_remaining = length - cursor;
+    }
+}
+
+static int has_data (void) {
+    while (message_remaining == 0 && cursor < fuzz_input_len()) {
+        next_message();
+    }
+    
+    return message_remaining > 0;
+}
+
+static ssize_t client_recv_iov (const struct iovec* iov, size_t count, int flags) {
+    size_t total = 0;
+    
+    if (!has_data()) {
+        return 0;
+    }
+    
+    for (size_t i = 0; i < count && total < message_remaining; ++i) {
+        size_t length = iov[i].iov_len;
+        
+        if (length > message_remaining - total) {
+            length = message_remaining - total;
+        }
+        
+        memcpy(iov[i].iov_base, fuzz_input_ptr() + cursor + total, length);
+        total += length;
+    }
+    
+    if (!(flags & MSG_PEEK)) {
+        cursor += total;
+        message_remaining -= total;
+    }
+    
+    return total;
+}
+
+static ssize_t client_recv (void* buffer, size_t length, int flags) {
+    struct iovec iov = {
+        .iov_base = buffer,
+        .iov_len = length,
+    };
+    
+    return client_recv_iov(&iov, 1, flags);
+}
+
+static ssize_t iov_length (const struct iovec* iov, size_t count) {
+    size_t total = 0;
+    
+    for (size_t i = 0; i < count; ++i) {
+        total += iov[i].iov_len;
+    }
+    
+    return total;
+}
+
+static void peer_address (struct sockaddr* addr, socklen_t* addrlen) {
+    struct sockaddr_in peer = (struct sockaddr_in) {
+        .sin_family = AF_INET,
+        .sin_port = htons(1337),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    
+    if (addr && addrlen) {
+        memcpy(addr, &peer, *addrlen < sizeof(peer) ? *addrlen : sizeof(peer));
+        *addrlen = sizeof(peer);
+    }
+}
+
+static int accept_client (int flags) {
+    if (connected) {
+        // Let non-blocking servers drain their accept queue
+        if (fcntl(listen_fd, F_GETFL) & O_NONBLOCK) {
+            errno = EAGAIN;
+            return -1;
+        }
+        
+        connected = 0;
+    }
+    
+    if (!spawn_persistent_loop(MAX_ITERATIONS)) {
+        exit(0);
+    }
+    
+    if (client_fd < 0) {
+        // Placeholder that is never connected, all I/O on it is emulated
+        client_fd = real_socket(listen_domain, SOCK_STREAM, 0);
+        
+        if (client_fd < 0) {
+            netemu_panic("Could not create client socket");
+        }
+    }
+    
+    if (fcntl(client_fd, F_SETFL, (flags & SOCK_NONBLOCK) ? O_NONBLOCK : 0) == -1 ||
+        fcntl(client_fd, F_SETFD, (flags & SOCK_CLOEXEC) ? FD_CLOEXEC : 0) == -1
+    ) {
+        netemu_panic("Could not set client socket flags");
+    }
+    
+    connected = 1;
+    cursor = 0;
+    message_remaining = 0;
+    return client_fd;
+}
+
+/* Only TCP sockets can become the emulated listener, a UDP socket on the same port is left alone */
+VISIBLE
+int socket (int domain, int type, int protocol) {
+    if (__builtin_expect(!real_socket, 0)) {
+        netemu_initialize();
+    }
+    
+    int fd = real_socket(domain, type, protocol);
+    
+    if (netemu_port >= 0) {
+        track_stream_socket(fd, (domain == AF_INET || domain == AF_INET6) && (type & 0xf) == SOCK_STREAM);
+    }
+    
+    return fd;
+}
+
+VISIBLE
+int bind (int fd, const struct sockaddr* addr, socklen_t addrlen) {
+    static int (*real_bind) (int, const struct sockaddr*, socklen_t) = NULL;
+    int port = -1;
+    
+    if (netemu_port >= 0 && addr && is_stream_socket(fd)) {
+        if (addr->sa_family == AF_INET && addrlen >= sizeof(struct sockaddr_in)) {
+            port = ntohs(((struct sockaddr_in*) addr)->sin_port);
+        } else if (addr->sa_family == AF_INET6 && addrlen >= sizeof(struct sockaddr_in6)) {
+            port = ntohs(((struct sockaddr_in6*) addr)->sin6_port);
+        }
+    }
+    
+    if (port >= 0 && port == netemu_port) {
+        listen_fd = fd;
+        listen_domain = addr->sa_family;
+        return 0;
+    }
+    
+    if (!real_bind) {
+        RESOLVE(real_bind, "bind");
+    }
+    
+    return real_bind(fd, addr, addrlen);
+}
+
+VISIBLE
+int listen (int fd, int backlog) {
+    static int (*real_listen) (int, int) = NULL;
+    
+    if (is_listener(fd)) {
+        return 0;
+    }
+    
+    if (!real_listen) {
+        RESOLVE(real_listen, "listen");
+    }
+    
+    return real_listen(fd, backlog);
+}
+
+VISIBLE
+int accept4 (int fd, struct sockaddr* addr, socklen_t* addrlen, int flags) {
+    static int (*real_accept4) (int, struct sockaddr*, socklen_t*, int) = NULL;
+    
+    if (is_listener(fd)) {
+        int r = accept_client(flags);
+        
+        if (r >= 0) {
+            peer_address(addr, addrlen);
+        }
+        
+        return r;
+    }
+    
+    if (!real_accept4) {
+        RESOLVE(real_accept4, "accept4");
+    }
+    
+    return real_accept4(fd, addr, addrlen, flags);
+}
+
+VISIBLE
+int accept (int fd, struct sockaddr* addr, socklen_t* addrlen) {
+    return accept4(fd, addr, addrlen, 0);
+}
+
+VISIBLE
+int getpeername (int fd, struct sockaddr* addr, socklen_t* addrlen) {
+    static int (*real_getpeername) (int, struct sockaddr*, socklen_t*) = NULL;
+    
+    if (is_client(fd)) {
+        peer_address(addr, addrlen);
+        return 0;
+    }
+    
+    if (!real_getpeername) {
+        RESOLVE(real_getpeername, "getpeername");
+    }
+    
+    return real_getpeername(fd, addr, addrlen);
+}
+
+VISIBLE
+ssize_t read (int fd, void* buffer, size_t length) {
+    if (is_client(fd)) {
+        return client_recv(buffer, length, 0);
+    }
+    
+    if (__builtin_expect(!real_read, 0)) {
+        netemu_initialize();
+    }
+    
+    return real_read(fd, buffer, length);
+}
+
+VISIBLE
+ssize_t recvfrom (int fd, void* buffer, size_t length, int flags, struct sockaddr* addr, socklen_t* addrlen) {
+    if (is_client(fd)) {
+        peer_address(addr, addrlen);
+        return client_recv(buffer, length, flags);
+    }
+    
+    if (__builtin_expect(!real_recvfrom, 0)) {
+        netemu_initialize();
+    }
+    
+    return real_recvfrom(fd, buffer, length, flags, addr, addrlen);
+}
+
+VISIBLE
+ssize_t recv (int fd, void* buffer, size_t length, int flags) {
+    return recvfrom(fd, buffer, length, flags, NULL, NULL);
+}
+
+VISIBLE
+ssize_t readv (int fd, const struct iovec* iov, int count) {
+    static ssize_t (*real_readv) (int, const struct iovec*, int) = NULL;
+    
+    if (is_client(fd)) {
+        return client_recv_iov(iov, count, 0);
+    }
+    
+    if (!real_readv) {
+        RESOLVE(real_readv, "readv");
+    }
+    
+    return real_readv(fd, iov, count);
+}
+
+VISIBLE
+ssize_t recvmsg (int fd, struct msghdr* msg, int flags) {
+    static ssize_t (*real_recvmsg) (int, struct msghdr*, int) = NULL;
+    
+    if (is_client(fd)) {
+        if (msg->msg_name) {
+            peer_address(msg->msg_name, &msg->msg_namelen);
+        }
+        
+        msg->msg_controllen = 0;
+        msg->msg_flags = 0;
+        return client_recv_iov(msg->msg_iov, msg->msg_iovlen, flags);
+    }
+    
+    if (!real_recvmsg) {
+        RESOLVE(real_recvmsg, "recvmsg");
+    }
+    
+    return real_recvmsg(fd, msg, flags);
+}
+
+VISIBLE
+ssize_t write (int fd, const void* buffer, size_t length) {
+    if (is_client(fd)) {
+        return length;
+    }
+    
+    if (__builtin_expect(!real_write, 0)) {
+        netemu_initialize();
+    }
+    
+    return real_write(fd, buffer, length);
+}
+
+VISIBLE
+ssize_t sendto (int fd, const void* buffer, size_t length, int flags, const struct sockaddr* addr, socklen_t addrlen) {
+    if (is_client(fd)) {
+        return length;
+    }
+    
+    if (__builtin_expect(!real_sendto, 0)) {
+        netemu_initialize();
+    }
+    
+    return real_sendto(fd, buffer, length, flags, addr, addrlen);
+}
+
+VISIBLE
+ssize_t send (int fd, const void* buffer, size_t length, int flags) {
+    return sendto(fd, buffer, length, flags, NULL, 0);
+}
+
+VISIBLE
+ssize_t writev (int fd, const struct iovec* iov, int count) {
+    static ssize_t (*real_writev) (int, const struct iovec*, int) = NULL;
+    
+    if (is_client(fd)) {
+        return iov_length(iov, count);
+    }
+    
+    if (!real_writev) {
+        RESOLVE(real_writev, "writev");
+    }
+    
+    return real_writev(fd, iov, count);
+}
+
+VISIBLE
+ssize_t sendmsg (int fd, const struct msghdr* msg, int flags) {
+    static ssize_t (*real_sendmsg) (int, const struct msghdr*, int) = NULL;
+    
+    if (is_client(fd)) {
+        return iov_length(msg->msg_iov, msg->msg_iovlen);
+    }
+    
+    if (!real_sendmsg) {
+        RESOLVE(real_sendmsg, "sendmsg");
+    }
+    
+    return real_sendmsg(fd, msg, flags);
+}
+
+VISIBLE
+int shutdown (int fd, int how) {
+    static int (*real_shutdown) (int, int) = NULL;
+    
+    if (is_client(fd)) {
+        return 0;
+    }
+    
+    if (!real_shutdown) {
+        RESOLVE(real_shutdown, "shutdown");
+    }
+    
+    return real_shutdown(fd, how);
+}
+
+VISIBLE
+int close (int fd) {
+    if (is_client(fd)) {
+        // Keep the descriptor such that the next accept() can reuse it
+        connected = 0;
+        return 0;
+    } else if (is_listener(fd)) {
+        listen_fd = -1;
+    }
+    
+    track_stream_socket(fd, 0);
+    
+    if (__builtin_expect(!real_close, 0)) {
+        netemu_initialize();
+    }
+    
+    return real_close(fd);
+}
+
+static short emulated_events (int fd, short events) {
+    short revents = 0;
+    
+    if (is_client(fd)) {
+        if (!connected) {
+            return POLLNVAL;
+        }
+        
+        revents |= events & POLLOUT;
+        
+        if (has_data()) {
+            revents |= events & POLLIN;
+        } else {
+            revents |= (events & POLLIN) | POLLHUP;
+        }
+    } else if (!connected) {
+        revents |= events & POLLIN;
+    }
+    
+    return revents;
+}
+
+VISIBLE
+int poll (struct pollfd* fds, nfds_t nfds, int timeout) {
+    int ready = 0, has_real = 0, has_listener = 0;
+    
+    if (listen_fd < 0 && client_fd < 0) {
+        if (__builtin_expect(!real_poll, 0)) {
+            netemu_initialize();
+        }
+        
+        return real_poll(fds, nfds, timeout);
+    }
+    
+    for (nfds_t i = 0; i < nfds; ++i) {
+        if (is_client(fds[i].fd) || is_listener(fds[i].fd)) {
+            fds[i].revents = emulated_events(fds[i].fd, fds[i].events);
+            ready += fds[i].revents != 0;
+            has_listener |= is_listener(fds[i].fd);
+        } else if (fds[i].fd >= 0) {
+            has_real = 1;
+        }
+    }
+    
+    if (has_real) {
+        struct pollfd real_fds[nfds];
+        
+        for (nfds_t i = 0; i < nfds; ++i) {
+            real_fds[i] = fds[i];
+            
+            if (is_client(fds[i].fd) || is_listener(fds[i].fd)) {
+                real_fds[i].fd = -1;
+            }
+        }
+        
+        int r = real_poll(real_fds, nfds, ready ? 0 : timeout);
+        
+        if (r < 0) {
+            return r;
+        }
+        
+        for (nfds_t i = 0; i < nfds; ++i) {
+            if (real_fds[i].fd >= 0) {
+                fds[i].revents = real_fds[i].revents;
+            }
+        }
+        
+        ready += r;
+    } else if (!ready && has_listener) {
+        // The target waits for a new connection while the old one is still open
+        connected = 0;
+        
+        for (nfds_t i = 0; i < nfds; ++i) {
+            if (is_listener(fds[i].fd)) {
+                fds[i].revents = fds[i].events & POLLIN;
+                ready += fds[i].revents != 0;
+            }
+        }
+    }
+    
+    return ready;
+}
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "utils.h"
+#include "output.h"
+
+/*
+    Output capture: The fuzzer hands a memfd to the target as stdout and stderr.
+    Both fds share one file offset, so writes are plain copies into the page cache
+    of the memfd instead of pipe transfers. Rewinding the offset at the start of
+    every iteration makes the memfd hold the output of the current iteration only
+    and the fuzzer reads the tail up to the offset when an iteration crashed or timed out.
+    An iteration that wrote more than the fuzzer ever reads gets the memfd truncated
+    back to that size on the next rewind, so a single noisy input does not pin its
+    output in memory for the rest of the campaign.
+*/
+
+#define FUZZ_OUTPUT_FD_ENV_VAR "__FUZZ_OUTPUT_FD"
+#define FUZZ_OUTPUT_CAP_ENV_VAR "__FUZZ_OUTPUT_CAP"
+
+static int output_fd = -1;
+static off_t output_cap = 0; // 0 means unbounded
+
+void output_capture_prepare (void) {
+    char* value = getenv(FUZZ_OUTPUT_FD_ENV_VAR);
+    
+    if (!value) {
+        return;
+    }
+    
+    output_fd = atoi(value);
+    
+    value = getenv(FUZZ_OUTPUT_CAP_ENV_VAR);
+    
+    if (value) {
+        output_cap = strtoll(value, NULL, 10);
+    }
+    
+    // Keep as little output as possible in stdio buffers that die with a crashing child
+    fflush(stdout);
+    if (setvbuf(stdout, NULL, _IOLBF, 0) != 0) {
+        panic(SOURCE_OUTPUT, "Could not change buffering of stdout");
+    }
+}
+
+void output_capture_rewind (void) {
+    if (output_fd < 0) {
+        return;
+    }
+    
+    // Output of the previous iteration must not end up in this one
+    fflush(stdout);
+    fflush(stderr);
+    
+    off_t end = lseek(output_fd, 0, SEEK_CUR);
+    
+    if (end == -1) {
+        panic(SOURCE_OUTPUT, "Could not get end of output");
+    }
+    
+    if (output_cap > 0 && end > output_cap && ftruncate(output_fd, output_cap) == -1) {
+        panic(SOURCE_OUTPUT, "Could not truncate output fd");
+    }
+    
+    if (lseek(output_fd, 0, SEEK_SET) == -1) {
+        panic(SOURCE_OUTPUT, "Could not rewind output fd");
+    }
+}
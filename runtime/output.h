@@ -0,0 +1,7 @@
+#ifndef __OUTPUT_H
+#define __OUTPUT_H
+
+void output_capture_prepare (void);
+void output_capture_rewind (void);
+
+#endif /* __OUTPUT_H */
@@ -7,17 +7,26 @@
 #include "utils.h"
 #include "ipc.h"
 #include "input.h"
+#include "replay.h"
+#include "leaks.h"
+#include "crash.h"
+#include "output.h"
+#include "forkcost.h"
+#include "trace.h"
 
 typedef enum {
     PERSISTENT_INIT,
     PERSISTENT_STOP,
     PERSISTENT_ITER,
+    PERSISTENT_REPLAY,
+    PERSISTENT_BISECT,
 } PersistentState;
 
 static size_t iterations;
 static ForkserverConfig config;
 static struct timespec start_time;
 static PersistentState state = PERSISTENT_INIT;
+static size_t bisect_next, bisect_end;
 
 static void check_timeout (int sig) {
     (void) sig;
@@ -33,8 +42,8 @@ static void check_timeout (int sig) {
 }
 
 __attribute__((noreturn))
-static void handle_crash (int sig) {
-    (void) sig;
+static void handle_crash (int sig, siginfo_t* info, void* ucontext) {
+    crash_record_fill(sig, info, ucontext);
     ipc_send_status(STATUS_CRASH);
     while (1) raise(SIGKILL);
 }
@@ -65,9 +74,9 @@ static int initialize_persistent_mode (void) {
     }
     
     action = (struct sigaction) {
-        .sa_handler = handle_crash,
+        .sa_sigaction = handle_crash,
         .sa_mask = signals,
-        .sa_flags = 0,
+        .sa_flags = SA_SIGINFO,
         .sa_restorer = NULL,
     };
     if (sigaction(SIGBUS, &action, NULL) == -1 ||
@@ -110,6 +119,82 @@ static int initialize_persistent_mode (void) {
     return 0;
 }
 
+static void reset_signal_handlers (void) {
+    struct itimerval disabled = {0};
+    
+    if (setitimer(ITIMER_REAL, &disabled, NULL) == -1 ||
+        signal(SIGALRM, SIG_DFL) == SIG_ERR ||
+        signal(SIGBUS, SIG_DFL) == SIG_ERR ||
+        signal(SIGABRT, SIG_DFL) == SIG_ERR ||
+        signal(SIGILL, SIG_DFL) == SIG_ERR ||
+        signal(SIGFPE, SIG_DFL) == SIG_ERR ||
+        signal(SIGSEGV, SIG_DFL) == SIG_ERR ||
+        signal(SIGTRAP, SIG_DFL) == SIG_ERR ||
+        signal(SIGINT, SIG_DFL) == SIG_ERR ||
+        signal(SIGTERM, SIG_DFL) == SIG_ERR
+    ) {
+        panic(SOURCE_PERSISTENT, "Could not reset signal handlers");
+    }
+}
+
+/*
+    Returns -1 in the child, otherwise whether the inputs [start, end) of the leak window leak.
+    The child arms the iteration timeout for every input, so if one of them hangs
+    the child is killed by the default action of SIGALRM.
+*/
+static int window_leaks (size_t start, size_t end) {
+    int status;
+    pid_t child = fork();
+    
+    if (child < 0) {
+        panic(SOURCE_PERSISTENT, "Could not fork");
+    } else if (child == 0) {
+        state = PERSISTENT_BISECT;
+        bisect_next = start;
+        bisect_end = end;
+        reset_signal_handlers();
+        return -1;
+    }
+    
+    if (waitpid(child, &status, 0) != child) {
+        panic(SOURCE_PERSISTENT, "Waitpid failed");
+    }
+    
+    return WIFEXITED(status) && WEXITSTATUS(status) != 0;
+}
+
+/* Returns 1 in the children that replay parts of the leak window and 0 once the culprit has been found */
+static int bisect_leak (size_t* culprit) {
+    size_t start = 0, end = leak_window_size();
+    
+    while (end - start > 1) {
+        size_t mid = start + (end - start) / 2;
+        int r = window_leaks(start, mid);
+        
+        if (r < 0) {
+            return 1;
+        } else if (r) {
+            end = mid;
+            continue;
+        }
+        
+        r = window_leaks(mid, end);
+        
+        if (r < 0) {
+            return 1;
+        } else if (r) {
+            start = mid;
+            continue;
+        }
+        
+        // The leak needs more than one input, blame the last one
+        break;
+    }
+    
+    *culprit = end - 1;
+    return 0;
+}
+
 static void set_timeout (void) {
     // Disable timeout
     if (config.timeout == 0) {
@@ -141,6 +226,14 @@ static void set_timeout (void) {
     }
 }
 
+static void clear_timeout (void) {
+    struct itimerval disabled = {0};
+    
+    if (setitimer(ITIMER_REAL, &disabled, NULL) == -1) {
+        panic(SOURCE_PERSISTENT, "Could not clear timer");
+    }
+}
+
 VISIBLE
 int spawn_persistent_loop (size_t iters) {
     int status;
@@ -153,16 +246,24 @@ int spawn_persistent_loop (size_t iters) {
     switch (state) {
         case PERSISTENT_INIT: {
             if (forkserver_handshake(MODE_PERSISTENT, &config)) {
+                if (replay_start(iters)) {
+                    state = PERSISTENT_REPLAY;
+                    return spawn_persistent_loop(iters);
+                }
+                
                 state = PERSISTENT_STOP;
                 return 1;
             }
             
+            fork_cost_profile();
+            
             if (initialize_persistent_mode()) {
                 panic(SOURCE_PERSISTENT, "Could not initialize persistent mode");
             }
             
             iterations = iters;
             started = 1;
+            leak_check_initialize();
             
             while (1) {
                 switch (ipc_recv_command()) {
@@ -176,6 +277,9 @@ int spawn_persistent_loop (size_t iters) {
                         _Exit(0);
                     }
                     case COMMAND_RUN: {
+                        fuzz_input_refresh();
+                        
+                        trace_event(TRACE_FORK_START, 0);
                         child = fork();
                         
                         if (child < 0) {
@@ -187,13 +291,34 @@ int spawn_persistent_loop (size_t iters) {
                                 panic(SOURCE_PERSISTENT, "Could not get start time");
                             }
                             set_timeout();
+                            fuzz_input_rewind();
+                            output_capture_rewind();
+                            leak_check_reset();
+                            leak_check_record();
+                            trace_event(TRACE_ITERATION_START, iters - iterations);
                             return 1;
                         } else {
+                            trace_event(TRACE_FORK_END, child);
+                            
                             if (waitpid(child, &status, 0) != child) {
                                 panic(SOURCE_PERSISTENT, "Waitpid failed");
                             }
+                            trace_event(TRACE_CHILD_EXIT, status);
                             
-                            if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGKILL) {
+                            if (leak_check_pending()) {
+                                size_t culprit;
+                                
+                                // The child might have followed a larger input channel that the window inputs need
+                                fuzz_input_refresh();
+                                
+                                if (bisect_leak(&culprit)) {
+                                    return spawn_persistent_loop(iters);
+                                }
+                                
+                                leak_window_load(culprit);
+                                leak_check_reset();
+                                ipc_send_status(STATUS_LEAK);
+                            } else if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGKILL) {
                                 ipc_send_status(convert_status(&config, status));
                             }
                             
@@ -207,6 +332,13 @@ int spawn_persistent_loop (size_t iters) {
             }
         }
         case PERSISTENT_ITER: {
+            trace_event(TRACE_ITERATION_END, iters - iterations);
+            
+            if (leak_check_iteration_end(iterations == 0)) {
+                // The persistent parent reports the leak
+                while (1) raise(SIGKILL);
+            }
+            
             if (iterations == 0) {
                 state = PERSISTENT_STOP;
                 return 0;
@@ -222,14 +354,39 @@ int spawn_persistent_loop (size_t iters) {
                     return 0;
                 }
                 case COMMAND_RUN: {
+                    fuzz_input_refresh();
+                    
                     if (clock_gettime(CLOCK_MONOTONIC_RAW, &start_time) == -1) {
                         panic(SOURCE_PERSISTENT, "Could not get start time");
                     }
+                    fuzz_input_rewind();
+                    output_capture_rewind();
+                    leak_check_record();
+                    trace_event(TRACE_ITERATION_START, iters - iterations);
                     return 1;
                 }
                 default: panic(SOURCE_PERSISTENT, "Invalid command in child");
             }
         }
+        case PERSISTENT_REPLAY: {
+            if (!replay_next()) {
+                state = PERSISTENT_STOP;
+                return 0;
+            }
+            
+            return 1;
+        }
+        case PERSISTENT_BISECT: {
+            if (bisect_next < bisect_end) {
+                leak_window_load(bisect_next++);
+                fuzz_input_rewind();
+                set_timeout();
+                return 1;
+            }
+            
+            clear_timeout();
+            _Exit(leak_check_run());
+        }
         case PERSISTENT_STOP: {
             return 0;
         }
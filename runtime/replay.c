@@ -0,0 +1,301 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "replay.h"
+#include "utils.h"
+#include "input.h"
+
+#ifndef PAGE_SIZE
+#define PAGE_SIZE 4096
+#endif
+
+/*
+    Standalone corpus replay: If no fuzzer is attached but CHEETAH_REPLAY
+    names a directory or a file that lists one path per line, the runtime
+    runs the persistent loop over all files of the corpus by itself.
+    A supervisor process forks a child that replays file after file and only
+    forks a new child if the previous one died.
+*/
+
+typedef struct {
+    size_t next;            // index of the next file to replay
+    size_t current;         // index of the file that is currently being replayed
+    int in_iteration;       // whether the child died while executing a file
+    struct timespec start;  // start of the current file
+} ReplayProgress;
+
+static char** corpus = NULL;
+static size_t corpus_size = 0;
+static volatile ReplayProgress* progress = NULL;
+static int report_fd = 2;
+static unsigned int timeout = 0; // in ms
+static size_t child_iterations;
+static size_t iterations;
+static unsigned char* mapping = NULL;
+static size_t mapping_size = 0;
+
+static void corpus_add (char* path) {
+    if ((corpus_size & (corpus_size - 1)) == 0) {
+        corpus = realloc(corpus, (corpus_size ? corpus_size * 2 : 1) * sizeof(char*));
+        
+        if (!corpus) {
+            panic(SOURCE_REPLAY, "Could not allocate corpus");
+        }
+    }
+    
+    corpus[corpus_size++] = path;
+}
+
+static void load_directory (const char* dir) {
+    struct dirent** entries;
+    int n = scandir(dir, &entries, NULL, alphasort);
+    
+    if (n < 0) {
+        panic(SOURCE_REPLAY, "Could not read corpus directory");
+    }
+    
+    for (int i = 0; i < n; ++i) {
+        char* path = NULL;
+        struct stat info;
+        
+        if (asprintf(&path, "%s/%s", dir, entries[i]->d_name) < 0) {
+            panic(SOURCE_REPLAY, "Could not allocate path");
+        }
+        
+        if (stat(path, &info) == 0 && S_ISREG(info.st_mode)) {
+            corpus_add(path);
+        } else {
+            free(path);
+        }
+        
+        free(entries[i]);
+    }
+    
+    free(entries);
+}
+
+static void load_file_list (const char* list) {
+    char* line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    FILE* file = fopen(list, "r");
+    
+    if (!file) {
+        panic(SOURCE_REPLAY, "Could not open corpus file list");
+    }
+    
+    while ((length = getline(&line, &capacity, file)) > 0) {
+        if (line[length - 1] == '\n') {
+            line[--length] = 0;
+        }
+        
+        if (length > 0) {
+            corpus_add(strdup(line));
+        }
+    }
+    
+    free(line);
+    fclose(file);
+}
+
+static void report (const char* status, int code, size_t index) {
+    struct timespec now;
+    
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    long usecs = (now.tv_sec - progress->start.tv_sec) * 1000000L + (now.tv_nsec - progress->start.tv_nsec) / 1000L;
+    
+    dprintf(report_fd, "%s\t%d\t%ld\t%s\n", status, code, usecs, corpus[index]);
+}
+
+static void set_alarm (unsigned int ms) {
+    struct itimerval interval = (struct itimerval) {
+        .it_interval = (struct timeval) {0},
+        .it_value = (struct timeval) {
+            .tv_sec = ms / 1000,
+            .tv_usec = (ms % 1000) * 1000,
+        },
+    };
+    
+    if (setitimer(ITIMER_REAL, &interval, NULL) == -1) {
+        panic(SOURCE_REPLAY, "Could not set timer");
+    }
+}
+
+/*
+    Maps a file followed by at least one writable byte, just like the other input channels.
+    Returns -1 with errno set if the file cannot be read.
+*/
+static int map_input (const char* path) {
+    struct stat info;
+    int fd = open(path, O_RDONLY);
+    
+    if (fd < 0) {
+        return -1;
+    } else if (fstat(fd, &info) == -1) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    
+    size_t length = info.st_size;
+    mapping_size = (length + PAGE_SIZE) & ~(PAGE_SIZE - 1);
+    mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    
+    if (!mapping || mapping == (void*) -1) {
+        panic(SOURCE_REPLAY, "Could not mmap");
+    }
+    
+    if (length > 0 && mmap(mapping, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) != mapping) {
+        int error = errno;
+        munmap(mapping, mapping_size);
+        mapping = NULL;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    
+    close(fd);
+    fuzz_input_set(mapping, length);
+    return 0;
+}
+
+static void finish_iteration (void) {
+    if (timeout) {
+        set_alarm(0);
+    }
+    
+    report("ok", 0, progress->current);
+    progress->in_iteration = 0;
+    progress->next = progress->current + 1;
+    
+    munmap(mapping, mapping_size);
+    mapping = NULL;
+}
+
+int replay_next (void) {
+    if (progress->in_iteration) {
+        finish_iteration();
+    }
+    
+    while (progress->next < corpus_size && iterations > 0) {
+        progress->current = progress->next;
+        
+        // The corpus might have changed since it was listed, skip files that are gone
+        if (map_input(corpus[progress->current])) {
+            int error = errno;
+            clock_gettime(CLOCK_MONOTONIC_RAW, (struct timespec*) &progress->start);
+            report("error", error, progress->current);
+            progress->next = progress->current + 1;
+            continue;
+        }
+        
+        iterations -= 1;
+        clock_gettime(CLOCK_MONOTONIC_RAW, (struct timespec*) &progress->start);
+        progress->in_iteration = 1;
+        
+        if (timeout) {
+            set_alarm(timeout);
+        }
+        
+        return 1;
+    }
+    
+    return 0;
+}
+
+static void supervise (void) {
+    while (progress->next < corpus_size) {
+        int status;
+        size_t next = progress->next;
+        pid_t child = fork();
+        
+        if (child < 0) {
+            panic(SOURCE_REPLAY, "Could not fork");
+        } else if (child == 0) {
+            iterations = child_iterations;
+            signal(SIGALRM, SIG_DFL);
+            return;
+        }
+        
+        if (waitpid(child, &status, 0) != child) {
+            panic(SOURCE_REPLAY, "Waitpid failed");
+        }
+        
+        if (progress->in_iteration) {
+            if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM && timeout) {
+                report("timeout", SIGALRM, progress->current);
+            } else if (WIFSIGNALED(status)) {
+                report("crash", WTERMSIG(status), progress->current);
+            } else {
+                report("exit", WEXITSTATUS(status), progress->current);
+            }
+            
+            progress->in_iteration = 0;
+            progress->next = progress->current + 1;
+        } else if (progress->next >= corpus_size && WIFSIGNALED(status)) {
+            // The target crashed after the last file (e.g. in an exit handler).
+            // An exit code is not reported since the last file already got its "ok".
+            report("crash", WTERMSIG(status), progress->current);
+        } else if (progress->next == next) {
+            // Forking again would die at the same spot forever
+            panic(SOURCE_REPLAY, "Replay child died before it replayed a file");
+        }
+    }
+    
+    _Exit(0);
+}
+
+int replay_start (size_t iters) {
+    struct stat info;
+    char* value = getenv(REPLAY_ENV_VAR);
+    
+    if (!value) {
+        return 0;
+    }
+    
+    if (stat(value, &info) == -1) {
+        panic(SOURCE_REPLAY, "Could not find corpus");
+    } else if (S_ISDIR(info.st_mode)) {
+        load_directory(value);
+    } else {
+        load_file_list(value);
+    }
+    
+    char* report_path = getenv(REPLAY_REPORT_ENV_VAR);
+    
+    if (report_path) {
+        report_fd = open(report_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        
+        if (report_fd < 0) {
+            panic(SOURCE_REPLAY, "Could not open report");
+        }
+    }
+    
+    char* timeout_value = getenv(REPLAY_TIMEOUT_ENV_VAR);
+    
+    if (timeout_value) {
+        timeout = atoi(timeout_value);
+    }
+    
+    progress = mmap(NULL, sizeof(ReplayProgress), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    
+    if (!progress || progress == (void*) -1) {
+        panic(SOURCE_REPLAY, "Could not mmap");
+    }
+    
+    child_iterations = iters;
+    supervise();
+    return 1;
+}
@@ -0,0 +1,13 @@
+#ifndef __REPLAY_H
+#define __REPLAY_H
+
+#include <stddef.h>
+
+#define REPLAY_ENV_VAR "CHEETAH_REPLAY"
+#define REPLAY_REPORT_ENV_VAR "CHEETAH_REPLAY_REPORT"
+#define REPLAY_TIMEOUT_ENV_VAR "CHEETAH_REPLAY_TIMEOUT"
+
+int replay_start (size_t iterations);
+int replay_next (void);
+
+#endif /* __REPLAY_H */
@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/shm.h>
+
+#include "utils.h"
+#include "trace.h"
+
+/*
+    Event trace: If the fuzzer passes a trace shm, the runtime records timestamped
+    events of the forkserver and the persistent loop into a ring buffer in it.
+    Writers claim a slot with an atomic increment of the head and publish the
+    event by storing its sequence number last, so recording is lock-free and
+    async-signal-safe. The fuzzer records its own events into the same ring.
+*/
+
+#define TRACE_SHM_ENV_VAR "__FUZZ_TRACE_SHM"
+
+typedef struct {
+    uint64_t sequence;  // index + 1 once the event is complete, 0 while it is written
+    uint64_t timestamp; // CLOCK_MONOTONIC in ns
+    uint32_t pid;
+    uint32_t kind;
+    uint64_t arg;
+} TraceEvent;
+
+typedef struct {
+    uint64_t head;      // index of the next event
+    uint64_t capacity;  // number of events, set by the fuzzer
+    TraceEvent events[];
+} TraceRing;
+
+static TraceRing* ring = NULL;
+static uint32_t pid = 0;
+
+static void update_pid (void) {
+    pid = getpid();
+}
+
+void trace_initialize (void) {
+    char* value = getenv(TRACE_SHM_ENV_VAR);
+    
+    if (!value || ring) {
+        return;
+    }
+    
+    ring = (TraceRing*) shmat(atoi(value), NULL, 0);
+    
+    if (!ring || ring == (void*) -1) {
+        panic(SOURCE_TRACE, "Could not attach to trace shm");
+    }
+    
+    if (ring->capacity == 0) {
+        shmdt(ring);
+        ring = NULL;
+        return;
+    }
+    
+    update_pid();
+    
+    if (pthread_atfork(NULL, NULL, update_pid) != 0) {
+        panic(SOURCE_TRACE, "Could not register fork handler for trace");
+    }
+}
+
+void trace_event (TraceKind kind, uint64_t arg) {
+    struct timespec now;
+    
+    if (!ring) {
+        return;
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    uint64_t index = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    TraceEvent* event = &ring->events[index % ring->capacity];
+    
+    __atomic_store_n(&event->sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    event->timestamp = (uint64_t) now.tv_sec * 1000000000UL + now.tv_nsec;
+    event->pid = pid;
+    event->kind = kind;
+    event->arg = arg;
+    __atomic_store_n(&event->sequence, index + 1, __ATOMIC_RELEASE);
+}
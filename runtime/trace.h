@@ -0,0 +1,20 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stdint.h>
+
+typedef enum {
+    TRACE_COMMAND = 0,          // arg: command
+    TRACE_STATUS = 1,           // arg: status
+    TRACE_FORK_START = 2,
+    TRACE_FORK_END = 3,         // arg: pid of the child
+    TRACE_ITERATION_START = 4,
+    TRACE_ITERATION_END = 5,
+    TRACE_CHILD_EXIT = 6,       // arg: wait status, the reason for restarting a persistent child
+    /* Kinds >= 16 are recorded by the fuzzer */
+} TraceKind;
+
+void trace_initialize (void);
+void trace_event (TraceKind kind, uint64_t arg);
+
+#endif /* __TRACE_H */
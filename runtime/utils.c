@@ -29,6 +29,22 @@ void panic (ErrorSource source, const char* message) {
             source_str = "IPC";
             break;
         }
+        case SOURCE_REPLAY: {
+            source_str = "Replay";
+            break;
+        }
+        case SOURCE_OUTPUT: {
+            source_str = "Output capture";
+            break;
+        }
+        case SOURCE_FORK_PROFILE: {
+            source_str = "Fork profile";
+            break;
+        }
+        case SOURCE_TRACE: {
+            source_str = "Trace";
+            break;
+        }
     }
     
     fprintf(stderr, "%s runtime failure: %s (errno=\"%s\")\n", source_str, message, strerror(errno));
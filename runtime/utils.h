@@ -11,6 +11,10 @@ typedef enum {
     SOURCE_PERSISTENT,
     SOURCE_FUZZ_INPUT,
     SOURCE_IPC,
+    SOURCE_REPLAY,
+    SOURCE_OUTPUT,
+    SOURCE_FORK_PROFILE,
+    SOURCE_TRACE,
 } ErrorSource;
 
 __attribute__((noreturn)) void panic (ErrorSource source, const char* message);
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "include/fuzzer-runtime.h"
+
+#define REGION_SIZE (64 * 4096)
+
+static unsigned char* map_region (int prot) {
+    unsigned char* region = mmap(NULL, REGION_SIZE, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    
+    if (region == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    
+    return region;
+}
+
+static void expect (int condition, const char* what) {
+    if (!condition) {
+        fprintf(stderr, "fork-advise: %s\n", what);
+        exit(1);
+    }
+}
+
+int main (void) {
+    unsigned char residency[REGION_SIZE / 4096];
+    
+    // Prefaulting a fresh private mapping gives it resident pages of its own
+    unsigned char* prefaulted = map_region(PROT_READ | PROT_WRITE);
+    expect(fork_advise_region(prefaulted, REGION_SIZE, FORK_ADVICE_PREFAULT) == 0, "prefault failed");
+    expect(mincore(prefaulted, REGION_SIZE, residency) == 0, "mincore failed");
+    
+    for (size_t i = 0; i < sizeof(residency); ++i) {
+        expect(residency[i] & 1, "prefaulted page is not resident");
+    }
+    
+    // Read-only mappings can be prefaulted too
+    unsigned char* readonly = map_region(PROT_READ);
+    expect(fork_advise_region(readonly, REGION_SIZE, FORK_ADVICE_PREFAULT) == 0, "prefault of read-only mapping failed");
+    
+    // Errors are reported instead of touching memory that is not there
+    unsigned char* unmapped = map_region(PROT_READ | PROT_WRITE);
+    munmap(unmapped, REGION_SIZE);
+    errno = 0;
+    expect(fork_advise_region(unmapped, REGION_SIZE, FORK_ADVICE_PREFAULT) == -1 && errno == ENOMEM, "prefault of unmapped range did not fail");
+    errno = 0;
+    expect(fork_advise_region(unmapped, REGION_SIZE, FORK_ADVICE_DONTFORK) == -1 && errno == ENOMEM, "dontfork of unmapped range did not fail");
+    
+    unsigned char* inaccessible = map_region(PROT_NONE);
+    errno = 0;
+    expect(fork_advise_region(inaccessible, REGION_SIZE, FORK_ADVICE_PREFAULT) == -1 && errno == EINVAL, "prefault of inaccessible mapping did not fail");
+    
+    // The children must not get this region
+    unsigned char* excluded = map_region(PROT_READ | PROT_WRITE);
+    memset(excluded, 0x41, REGION_SIZE);
+    expect(fork_advise_region(excluded, REGION_SIZE, FORK_ADVICE_DONTFORK) == 0, "dontfork failed");
+    
+    while (spawn_persistent_loop(MAX_ITERATIONS)) {
+        unsigned char* fuzz_input = fuzz_input_ptr();
+        size_t len = fuzz_input_len();
+        
+        if (len == 8 && !memcmp(fuzz_input, "dontfork", 8)) {
+            // Faults because the region is missing in the child
+            printf("%d\n", *(volatile unsigned char*) excluded);
+        } else if (len == 8 && !memcmp(fuzz_input, "prefault", 8)) {
+            prefaulted[len] = 1;
+        }
+    }
+    
+    return 0;
+}
@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "fuzzer-runtime.h"
+
+/*
+    Measures the cost of accessing the input in a tight loop,
+    through the exported functions or through the inline fast path.
+    Built with optimizations against libruntime.a, see the Makefile.
+*/
+
+volatile unsigned long checksum = 0;
+
+// The sum is kept in a local because stores to an unsigned long could alias the input length
+static void do_calls (void) {
+    while (spawn_persistent_loop(MAX_ITERATIONS)) {
+        unsigned long sum = 0;
+        
+        for (size_t i = 0; i < fuzz_input_len(); ++i) {
+            sum += fuzz_input_ptr()[i];
+        }
+        
+        checksum = sum;
+    }
+}
+
+static void do_inline (void) {
+    while (spawn_persistent_loop(MAX_ITERATIONS)) {
+        unsigned long sum = 0;
+        
+        for (size_t i = 0; i < fuzz_input_len_fast(); ++i) {
+            sum += fuzz_input_ptr_fast()[i];
+        }
+        
+        checksum = sum;
+    }
+}
+
+int main (int argc, char** argv) {
+    if (argc < 2) {
+        printf("USAGE: %s { calls | inline }\n", argv[0]);
+        return 1;
+    }
+    
+    if (!strcmp(argv[1], "calls")) {
+        do_calls();
+    } else if (!strcmp(argv[1], "inline")) {
+        do_inline();
+    } else {
+        return 1;
+    }
+    
+    _Exit(0);
+}
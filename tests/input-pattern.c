@@ -0,0 +1,43 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "include/fuzzer-runtime.h"
+
+/*
+    Expects inputs that start with their own length as a native-endian uint64_t,
+    followed by a byte that says whether to crash ('C') or not and then byte i
+    being i % 251. Anything else crashes as well. Tests alternate the crash byte
+    between inputs, so a runtime that still reads the previous input from an
+    input channel that the fuzzer replaced reports the wrong result.
+*/
+
+#define HEADER_SIZE (sizeof(uint64_t) + 1)
+
+int main (void) {
+    while (spawn_persistent_loop(MAX_ITERATIONS)) {
+        unsigned char* input = fuzz_input_ptr();
+        size_t len = fuzz_input_len();
+        uint64_t expected;
+        
+        if (len < HEADER_SIZE) {
+            abort();
+        }
+        
+        memcpy(&expected, input, sizeof(expected));
+        
+        if (len != expected) {
+            abort();
+        }
+        
+        for (size_t i = HEADER_SIZE; i < len; ++i) {
+            if (input[i] != i % 251) {
+                abort();
+            }
+        }
+        
+        if (input[sizeof(expected)] == 'C') {
+            abort();
+        }
+    }
+}
@@ -0,0 +1,31 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int initialized = 0;
+
+int LLVMFuzzerInitialize (int* argc, char*** argv) {
+    (void) argc;
+    (void) argv;
+    initialized = 1;
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput (const unsigned char* data, size_t size) {
+    if (!initialized) {
+        abort();
+    }
+    
+    if (size == 5 && !memcmp(data, "crash", 5)) {
+        abort();
+    }
+    
+    // Reads one byte past the input, which ASan must detect
+    if (size == 3 && !memcmp(data, "oob", 3)) {
+        volatile unsigned char past = data[size];
+        (void) past;
+    }
+    
+    printf("Got: %.*s\n", (int) size, data);
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include "include/fuzzer-runtime.h"
+
+static size_t read_all (int fd, unsigned char* buf, size_t size) {
+    size_t length = 0;
+    
+    while (length < size) {
+        ssize_t r = read(fd, &buf[length], size - length);
+        
+        if (r <= 0) {
+            break;
+        }
+        
+        length += r;
+    }
+    
+    return length;
+}
+
+int main (int argc, char** argv) {
+    static unsigned char buf[4096];
+    
+    while (spawn_persistent_loop(MAX_ITERATIONS)) {
+        size_t length;
+        
+        if (argc > 1) {
+            int fd = open(argv[1], O_RDONLY);
+            
+            if (fd < 0) {
+                abort();
+            }
+            
+            length = read_all(fd, buf, sizeof(buf));
+            close(fd);
+        } else if (fuzz_input_fd() == 0) {
+            // Buffered reads must not see data or EOF of the previous iteration
+            int c;
+            length = 0;
+            
+            while (length < sizeof(buf) && (c = getchar()) != EOF) {
+                buf[length++] = c;
+            }
+        } else {
+            length = read_all(fuzz_input_fd(), buf, sizeof(buf));
+        }
+        
+        if (length != fuzz_input_len() || memcmp(buf, fuzz_input_ptr(), length)) {
+            abort();
+        }
+        
+        printf("Got: %.*s\n", (int) length, buf);
+    }
+}
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define PORT 31337
+
+static void handle_client (int client) {
+    char buf[256];
+    struct pollfd pfd = {
+        .fd = client,
+        .events = POLLIN,
+    };
+    
+    while (poll(&pfd, 1, -1) == 1) {
+        ssize_t r = recv(client, buf, sizeof(buf) - 1, 0);
+        
+        if (r <= 0) {
+            break;
+        }
+        
+        buf[r] = 0;
+        
+        if (!strcmp(buf, "crash")) {
+            abort();
+        } else if (!strcmp(buf, "quit")) {
+            break;
+        }
+        
+        send(client, buf, r, 0);
+    }
+    
+    close(client);
+}
+
+int main (void) {
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    
+    if (server < 0 ||
+        bind(server, (struct sockaddr*) &addr, sizeof(addr)) == -1 ||
+        listen(server, 1) == -1
+    ) {
+        perror("server");
+        return 1;
+    }
+    
+    while (1) {
+        int client = accept(server, NULL, NULL);
+        
+        if (client < 0) {
+            perror("accept");
+            return 1;
+        }
+        
+        handle_client(client);
+    }
+}
@@ -0,0 +1,35 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "include/fuzzer-runtime.h"
+
+__attribute__((noinline))
+static void leak (void) {
+    volatile char* buf = malloc(16);
+    buf[0] = 0;
+}
+
+int main (void) {
+    while (spawn_persistent_loop(MAX_ITERATIONS)) {
+        unsigned char* fuzz_input = fuzz_input_ptr();
+        size_t len = fuzz_input_len();
+        
+        if (len >= 4 && !memcmp(fuzz_input, "leak", 4)) {
+            leak();
+        } else if (len > 5 && !memcmp(fuzz_input, "hang:", 5)) {
+            // Hangs in every execution but the first one, i.e. when the leak window is bisected
+            char path[256];
+            snprintf(path, sizeof(path), "%.*s", (int) (len - 5), &fuzz_input[5]);
+            
+            if (access(path, F_OK) == 0) {
+                while (1) pause();
+            }
+            
+            fclose(fopen(path, "w"));
+        }
+    }
+    
+    return 0;
+}